@@ -0,0 +1,246 @@
+/* pagesim.c 
+ *
+ * This program replays a page reference trace, recorded by running
+ * Nachos with "-tr trace", against the LRU, FIFO, clock (second chance)
+ * and optimal (Belady's MIN) replacement policies.  For each number of
+ * physical pages, it prints how many page faults each policy would
+ * have had; for each TLB size, how many TLB misses.
+ *
+ *	usage: pagesim [-f frames,...] [-t entries,...] trace
+ *
+ * The pages of all the address spaces in the trace compete for memory,
+ * as they do in Nachos (replacement is global).  The TLB is taken to be
+ * fully associative, with entries tagged by address space.  Faults
+ * (misses) include the first reference to each page.
+ *
+ * Copyright (c) 1992-1993 The Regents of the University of California.
+ * All rights reserved.  See copyright.h for copyright notice and limitation 
+ * of liability and disclaimer of warranty provisions.
+ */
+
+#define MAIN
+#include "copyright.h" 
+#undef MAIN
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pagetrace.h"
+
+#define MaxSizes	32	/* sizes in a sweep, at most */
+
+enum { LRU, FIFO, CLOCK, OPT, NumPolicies };
+static char *policyNames[NumPolicies] = { "LRU", "FIFO", "CLOCK", "OPT" };
+
+static int numRecords;		/* references in the trace, runs
+				 * counted once */
+static int *pageIds;		/* for each, the page referenced,
+				 * numbered from 0 */
+static int *nextUse;		/* for each, the next reference to the
+				 * same page, numRecords if none */
+static int numPages;		/* distinct pages referenced */
+
+static void
+Fatal(char *message, char *name)
+{
+    fprintf(stderr, "pagesim: %s %s\n", message, name);
+    exit(1);
+}
+
+/* Read the trace in file "name", number the pages it references, and
+ * work out when each page is referenced next.  Return the header.
+ */
+static TraceHeader
+ReadTrace(char *name)
+{
+    FILE *fp = fopen(name, "rb");
+    TraceHeader header;
+    unsigned int *records;
+    unsigned int *keys;
+    int *lastUse;
+    int maxRecords = 1024, hashSize, i;
+
+    if (fp == NULL)
+	Fatal("cannot open", name);
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+	header.traceMagic != TRACEMAGIC)
+	Fatal("not a page reference trace:", name);
+
+    records = (unsigned int *) malloc(maxRecords * sizeof(unsigned int));
+    numRecords = 0;
+    while (fread(&records[numRecords], sizeof(unsigned int), 1, fp) == 1)
+	if (++numRecords == maxRecords) {
+	    maxRecords *= 2;
+	    records = (unsigned int *)
+		realloc(records, maxRecords * sizeof(unsigned int));
+	}
+    fclose(fp);
+
+    /* number the pages, through a hash table of (space, vpn) keys */
+    for (hashSize = 1024; hashSize < 2 * numRecords; hashSize *= 2)
+	;
+    keys = (unsigned int *) malloc(hashSize * sizeof(unsigned int));
+    lastUse = (int *) malloc(hashSize * sizeof(int));	/* page ids, here */
+    for (i = 0; i < hashSize; i++)
+	lastUse[i] = -1;
+    pageIds = (int *) malloc(numRecords * sizeof(int));
+    numPages = 0;
+    for (i = 0; i < numRecords; i++) {
+	unsigned int key = TracePage(records[i]);
+	int h = (key * 2654435761U) & (hashSize - 1);
+
+	while (lastUse[h] != -1 && keys[h] != key)
+	    h = (h + 1) & (hashSize - 1);
+	if (lastUse[h] == -1) {
+	    keys[h] = key;
+	    lastUse[h] = numPages++;
+	}
+	pageIds[i] = lastUse[h];
+    }
+    free(keys);
+    free(records);
+
+    /* then, going backwards, when each page is used next */
+    nextUse = (int *) malloc(numRecords * sizeof(int));
+    for (i = 0; i < numPages; i++)
+	lastUse[i] = numRecords;
+    for (i = numRecords - 1; i >= 0; i--) {
+	nextUse[i] = lastUse[pageIds[i]];
+	lastUse[pageIds[i]] = i;
+    }
+    free(lastUse);
+    return header;
+}
+
+/* Replay the trace with "size" pages (or TLB entries) and replacement
+ * policy "policy".  Return the number of faults.
+ */
+static int
+Simulate(int policy, int size)
+{
+    int *slotOf = (int *) malloc(numPages * sizeof(int));
+    int *page = (int *) malloc(size * sizeof(int));
+    int *stamp = (int *) malloc(size * sizeof(int));	/* last use (LRU),
+							 * next use (OPT) */
+    char *used = (char *) malloc(size);			/* use bits (CLOCK) */
+    int filled = 0, hand = 0, faults = 0, i, s;
+
+    for (i = 0; i < numPages; i++)
+	slotOf[i] = -1;
+    for (i = 0; i < numRecords; i++) {
+	s = slotOf[pageIds[i]];
+	if (s == -1) {
+	    faults++;
+	    if (filled < size)
+		s = filled++;
+	    else {
+		int k;
+
+		switch (policy) {
+		  case LRU:
+		    for (s = 0, k = 1; k < size; k++)
+			if (stamp[k] < stamp[s])
+			    s = k;
+		    break;
+		  case OPT:
+		    for (s = 0, k = 1; k < size; k++)
+			if (stamp[k] > stamp[s])
+			    s = k;
+		    break;
+		  case CLOCK:
+		    while (used[hand]) {
+			used[hand] = 0;
+			hand = (hand + 1) % size;
+		    }
+		    /* fall through: take the page under the hand */
+		  case FIFO:
+		    s = hand;
+		    hand = (hand + 1) % size;
+		    break;
+		}
+		slotOf[page[s]] = -1;
+	    }
+	    page[s] = pageIds[i];
+	    slotOf[pageIds[i]] = s;
+	}
+	stamp[s] = (policy == OPT) ? nextUse[i] : i;
+	used[s] = 1;
+    }
+    free(slotOf);
+    free(page);
+    free(stamp);
+    free(used);
+    return faults;
+}
+
+/* Parse a comma-separated list of sizes into "sizes".  Return how many
+ * there are.
+ */
+static int
+ParseSizes(char *list, int *sizes)
+{
+    int n = 0;
+    char *p;
+
+    for (p = strtok(list, ","); p != NULL; p = strtok(NULL, ",")) {
+	if (n == MaxSizes || atoi(p) <= 0)
+	    Fatal("bad list of sizes:", list);
+	sizes[n++] = atoi(p);
+    }
+    return n;
+}
+
+static void
+PrintSweep(char *title, char *column, int *sizes, int numSizes,
+	   unsigned int references)
+{
+    int i, p;
+
+    printf("\n%s\n%8s", title, column);
+    for (p = 0; p < NumPolicies; p++)
+	printf(" %17s", policyNames[p]);
+    printf("\n");
+    for (i = 0; i < numSizes; i++) {
+	printf("%8d", sizes[i]);
+	for (p = 0; p < NumPolicies; p++) {
+	    int faults = Simulate(p, sizes[i]);
+
+	    printf(" %9d (%5.2f%%)", faults,
+		   references ? 100.0 * faults / references : 0.0);
+	}
+	printf("\n");
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    static char defaultFrames[] = "4,8,16,24,32,48,64";
+    static char defaultEntries[] = "2,4,8,16,32,64";
+    int frames[MaxSizes], entries[MaxSizes];
+    int numFrames, numEntries;
+    char *frameList = defaultFrames, *entryList = defaultEntries;
+    TraceHeader header;
+
+    for (argc--, argv++; argc > 1; argc -= 2, argv += 2)
+	if (!strcmp(*argv, "-f"))
+	    frameList = argv[1];
+	else if (!strcmp(*argv, "-t"))
+	    entryList = argv[1];
+	else
+	    break;
+    if (argc != 1) {
+	fprintf(stderr, "usage: pagesim [-f frames,...] [-t entries,...] trace\n");
+	exit(1);
+    }
+    numFrames = ParseSizes(frameList, frames);
+    numEntries = ParseSizes(entryList, entries);
+
+    header = ReadTrace(*argv);
+    printf("%u references (%d runs), %d distinct pages of %u bytes\n",
+	   header.references, numRecords, numPages, header.pageSize);
+    PrintSweep("Page faults", "frames", frames, numFrames, header.references);
+    PrintSweep("TLB misses", "entries", entries, numEntries, header.references);
+    return 0;
+}
@@ -0,0 +1,35 @@
+/* pagetrace.h 
+ *     Format of the page reference traces written by Nachos (-tr), and
+ *     replayed by pagesim.
+ *
+ *     A trace is a header, followed by one word per page reference, in
+ *     host byte order.  A run of reads (or of writes) of the same page,
+ *     by the same address space, is recorded once; that changes nothing for
+ *     the replacement policies pagesim replays (the page is resident,
+ *     and was the most recently used, for every reference after the
+ *     first), and "references" in the header still counts them all.
+ */
+
+#define TRACEMAGIC	0x4e545243	/* magic number denoting a Nachos
+					 * page reference trace
+					 */
+
+typedef struct traceHeader {
+   unsigned int traceMagic;	/* should be TRACEMAGIC */
+   unsigned int pageSize;	/* bytes per page, when traced */
+   unsigned int references;	/* number of references traced */
+} TraceHeader;
+
+/* Each reference: the virtual page, the address space, and whether it
+ * was a write.
+ */
+#define TraceVpnBits	24
+#define TraceVpnMask	((1 << TraceVpnBits) - 1)
+#define TraceSpaceMask	0x7f
+#define TraceWrite	0x80000000
+
+#define TraceRecord(spaceId, vpn, writing) \
+	((((unsigned) (spaceId) & TraceSpaceMask) << TraceVpnBits) | \
+	 ((vpn) & TraceVpnMask) | \
+	 ((writing) ? TraceWrite : 0))
+#define TracePage(record)	((record) & ~TraceWrite)	/* space and vpn */
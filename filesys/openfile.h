@@ -52,6 +52,7 @@ class OpenFile {
 		}
 
     int Length() { Lseek(file, 0, 2); return Tell(file); }
+    int FileId() { return FileNumber(file); }
     
   private:
     int file;
@@ -85,6 +86,8 @@ class OpenFile {
 					// file (this interface is simpler 
 					// than the UNIX idiom -- lseek to 
 					// end of file, tell, lseek back 
+    int FileId() { return hdrSector; }	// Identifies the file: the sector
+					// of its header
     
   public:
     FileHeader *hdr;			// Header for this file
@@ -21,6 +21,9 @@
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
+
+#include <limits.h>
+
 #include "interrupt.h"
 #include "system.h"
 
@@ -178,6 +181,31 @@ Interrupt::OneTick()
     }
 }
 
+//----------------------------------------------------------------------
+// Interrupt::UserTicksBeforeDue
+// 	Return how many more user instructions can be executed before
+//	the earliest pending interrupt is due.  For that many instructions
+//	OneTick would only advance the clock, so Machine::Run may do just
+//	that instead of calling it.
+//
+//	Returns 0 -- every tick must go through OneTick -- unless we are
+//	in user mode with interrupts enabled, and the tick-by-tick
+//	debugging output is off.
+//----------------------------------------------------------------------
+int
+Interrupt::UserTicksBeforeDue()
+{
+    int when;
+
+    if (status != UserMode || level != IntOn || DebugIsEnabled('i'))
+	return 0;
+    if (pending->SortedPeek(&when) == NULL)	// nothing will ever be due
+	return INT_MAX / UserTick;
+    if (when <= stats->totalTicks)
+	return 0;
+    return (when - stats->totalTicks - 1) / UserTick;
+}
+
 //----------------------------------------------------------------------
 // Interrupt::YieldOnReturn
 // 	Called from within an interrupt handler, to cause a context switch
@@ -242,6 +270,12 @@ Interrupt::Halt()
 {
     printf("Machine halting!\n\n");
     stats->Print();
+#ifdef USER_PROGRAM
+    if (machine != NULL) {
+	machine->printEngineStat();
+	machine->coreMap->Print();
+    }
+#endif
     Cleanup();     // Never returns.
 }
 
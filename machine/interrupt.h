@@ -113,6 +113,8 @@ class Interrupt {
     					// by the hardware device simulators.
     
     void OneTick();       		// Advance simulated time
+    int UserTicksBeforeDue();		// How many user instructions can run
+					// before a pending interrupt is due?
 
   private:
     IntStatus level;		// are interrupts enabled or disabled?
@@ -10,6 +10,16 @@
 #include "machine.h"
 #include "copyright.h"
 #include "system.h"
+#include "swapdisk.h"
+#include "pageout.h"
+#include "memsched.h"
+#include "pagetrace.h"
+
+// The size of main memory and of swap space; see Initialize for the
+// flags that change them.
+int PageSize = SectorSize;
+int NumPhysPages = 32;
+int NumSwapPages = 1024;
 
 // Textual names of the exceptions that can be generated by user program
 // execution, for debugging.
@@ -60,32 +70,54 @@ Machine::Machine(bool debug)
     mainMemory = new char[MemorySize];
     for (i = 0; i < MemorySize; i++)
         mainMemory[i] = 0;
-    memStatusMap = new BitMap(NumPhysPages);
+    coreMap = new CoreMap(NumPhysPages);
+    decodeCache = new Instruction[MemorySize / 4];
+    decodeValid = new bool[MemorySize / 4];
+    for (i = 0; i < MemorySize / 4; i++)
+        decodeValid[i] = FALSE;
+    threadedCode = new ThreadedOp[ThreadedSlot(MemorySize)];
+    for (i = 0; i < ThreadedSlot(MemorySize); i++)
+        threadedCode[i].handler = NULL;
+    translationEpoch = 0;
+    useThreadedCode = FALSE;
+    batchTicks = FALSE;
+    hardwareWalker = FALSE;
 
-    swapSpace = new char[SwapSize];
-    for (int i = 0; i < SwapSize; ++i)
-        swapSpace[i] = 0;
-    swapStatusMap = new BitMap(NumSwapPages);
+    swapDisk = new SwapDisk("SWAP", NumSwapPages);
+    pageOutDaemon = new PageOutDaemon(NumPhysPages / 16, NumPhysPages / 8);
+    memScheduler = new MemoryScheduler();
+    asidStatusMap = new BitMap(NumASIDs);
+    currentASID = NoASID;
 
-    PTReplaceStrategy = PT_FIFO;
 #ifdef USE_TLB
     printf("    Initializing TLB\n");
-    printf("    TLB pages num: %d\n", TLBSize);
-    tlb = new TranslationEntry[TLBSize];
-    for (i = 0; i < TLBSize; i++)
-        tlb[i].valid = FALSE;
+    tlb = NULL;
+    TLBClockHand = NULL;
+    SetTLBGeometry(TLBSize, 0);
     TLBReplaceStrategy = TLB_LRU;
 #else  // use linear page table
     printf("        TLB Not Used\n");
     tlb = NULL;
+    TLBEntries = 0;
+    TLBWays = 0;
+    TLBClockHand = NULL;
 #endif
-    pageTable = NULL;
-    swapPageTable = NULL;
-    execFile = NULL;
-    offsetVaddrToFile = 0;
+    // as many alias entries as pages: on average, every page can be
+    // shared by two address spaces (see ShareSpace)
+    pageTable = new InvertedPageTable(NumPhysPages, NumPhysPages);
+    swapPageTable = new InvertedPageTable(NumSwapPages, NumSwapPages);
+    currentSpaceId = -1;
+    pageTableSize = 0;
 
     singleStep = debug;
     timeStamp = 0;
+    clockHand = 0;
+    SetFaultAround(0);
+    FlushTranslationCache();
+    traceFile = -1;
+    traceBuffer = NULL;
+    hostStartTime = 0;
+    exceptionCount = 0;
     TLBHitCount = 0;
     TLBMissCount = 0;
     CheckEndian();
@@ -98,14 +130,23 @@ Machine::Machine(bool debug)
 
 Machine::~Machine()
 {
+    StopTrace();
     delete[] mainMemory;
-    delete memStatusMap;
-    delete[] swapSpace;
-    delete swapStatusMap;
+    delete coreMap;
+    delete[] decodeCache;
+    delete[] decodeValid;
+    delete[] threadedCode;
+    delete swapDisk;
+    delete pageOutDaemon;
+    delete memScheduler;
+    delete asidStatusMap;
+    delete pageTable;
+    delete swapPageTable;
     if (tlb != NULL)
         {
             delete[] tlb;
         }
+    delete[] TLBClockHand;
 }
 
 //----------------------------------------------------------------------
@@ -123,6 +164,7 @@ void Machine::RaiseException(ExceptionType which, int badVAddr)
     DEBUG('m', "Exception: %s\n", (exceptionNames[which]));
 
     //  ASSERT(interrupt->getStatus() == UserMode);
+    exceptionCount++;
     registers[BadVAddrReg] = badVAddr;
     DelayedLoad(0, 0);  // finish anything in progress
     interrupt->setStatus(SystemMode);
@@ -241,86 +283,139 @@ void Machine::IncreasePC()
     WriteRegister(NextPCReg, ReadRegister(NextPCReg) + 4);
 }
 
+//----------------------------------------------------------------------
+// Machine::SetTLBGeometry
+// 	Replace the TLB with an empty one of "entries" entries, organized
+//	as sets of "ways" entries each.  A virtual page can only be cached
+//	in one set, so a lookup only searches that set.  "ways" of 1 gives
+//	a direct-mapped TLB; 0 (or "entries" or more) a fully associative
+//	one.
+//----------------------------------------------------------------------
+
+void Machine::SetTLBGeometry(int entries, int ways)
+{
+    ASSERT(entries > 0 && ways >= 0);
+    TLBEntries = entries;
+    TLBWays = ways;
+    if (ways == 0 || ways >= entries)
+        TLBSetSize = entries;  // fully associative
+    else
+        {
+            ASSERT(entries % ways == 0);
+            TLBSetSize = ways;
+        }
+    TLBSets = entries / TLBSetSize;
+
+    delete[] tlb;
+    delete[] TLBClockHand;
+    tlb = new TranslationEntry[TLBEntries];
+    for (int i = 0; i < TLBEntries; i++)
+        {
+            tlb[i].valid = FALSE;
+            tlb[i].use = FALSE;
+            tlb[i].tValue = 0;
+        }
+    TLBClockHand = new int[TLBSets];
+    for (int i = 0; i < TLBSets; i++)
+        TLBClockHand[i] = 0;
+    FlushTranslationCache();
+    printf("    TLB pages num: %d, %d set(s) of %d\n", TLBEntries, TLBSets, TLBSetSize);
+}
+
+//----------------------------------------------------------------------
+// Machine::TLBMissHandler
+// 	Load the translation of the page at BadVAddrReg into the TLB,
+//	loading the page into memory first if need be.
+//----------------------------------------------------------------------
+
 void Machine::TLBMissHandler()
 {
     int badVAddr = ReadRegister(BadVAddrReg);
     unsigned int vpn = (unsigned)badVAddr / PageSize;
 
-    int physPage = 0;
-    if (pageTable[vpn].valid)
-        {
-            physPage = pageTable[vpn].physicalPage;
-        }
-    else
+    int physPage = pageTable->Lookup(currentSpaceId, vpn);
+    if (physPage == -1)
         {
             physPage = PageLoad(vpn);
         }
-
-    switch (PTReplaceStrategy)
+    else  // maybe an alias of the page (see InvertedPageTable)
         {
-            case PT_LRU:
-                {
-                    pageTable[vpn].tValue = machine->timeStamp;  // update last used time
-                }
-                break;
-                // case PT_LFU:
-                //     {
-                //         pageTable[vpn].tValue++;  // update used count
-                //     }
-                //     break;
+            physPage = pageTable->entries[physPage].physicalPage;
         }
+    RefillTLB(vpn, physPage);
+}
 
-    bool invalidExist = false;
-    for (int i = 0; i < TLBSize; ++i)
+//----------------------------------------------------------------------
+// Machine::RefillTLB
+// 	Load the translation of virtual page "vpn" of the running address
+//	space, which is in physical page "physPage", into the TLB.  It goes
+//	into an invalid entry of its set if there is one, otherwise into
+//	the entry chosen by TLBReplaceStrategy, whose dirty and use bits
+//	are then written back to the page table.  Returns the TLB entry
+//	used.
+//
+//	Called by TLBMissHandler, or directly by Translate if the
+//	hardware walker is on.
+//----------------------------------------------------------------------
+
+int Machine::RefillTLB(int vpn, int physPage)
+{
+    InvertedTranslationEntry *entry = &pageTable->entries[physPage];
+
+    entry->use = TRUE;  // the page is being referenced
+
+    int set = vpn % TLBSets;
+    int first = set * TLBSetSize;  // the entries of the set
+    int replacedTLB = -1;
+    for (int i = first; i < first + TLBSetSize; ++i)
         {
             if (!tlb[i].valid)
                 {
-                    tlb[i].virtualPage = vpn;
-                    tlb[i].physicalPage = physPage;
-                    tlb[i].valid = true;
-                    tlb[i].dirty = pageTable[vpn].dirty;
-                    tlb[i].readOnly = pageTable[vpn].readOnly;
-                    invalidExist = true;
+                    replacedTLB = i;
                     break;
                 }
         }
 
-    if (!invalidExist)
+    if (replacedTLB == -1)
         {
-            int replacedTLB = 0;
             switch (TLBReplaceStrategy)
                 {
-                    case TLB_LRU:
+                    case TLB_LRU:   // tValue is the last used time
+                    case TLB_FIFO:  // tValue is the created time
                         {
-                            int earliestUsedTime = (1 << 30);
-                            for (int i = 0; i < TLBSize; ++i)
+                            replacedTLB = first;
+                            for (int i = first + 1; i < first + TLBSetSize; ++i)
                                 {
-                                    if (tlb[i].tValue < earliestUsedTime)
+                                    if (tlb[i].tValue < tlb[replacedTLB].tValue)
                                         {
-                                            earliestUsedTime = tlb[i].tValue;
                                             replacedTLB = i;
                                         }
                                 }
                         }
                         break;
-                    case TLB_FIFO:
+                    case TLB_RANDOM:
                         {
-                            int esrliestCreatedTime = (1 << 30);
-                            for (int i = 0; i < TLBSize; ++i)
+                            replacedTLB = first + Random() % TLBSetSize;
+                        }
+                        break;
+                    case TLB_CLOCK:
+                        {  // give entries used since the hand last passed a second chance
+                            for (;;)
                                 {
-                                    if (tlb[i].tValue < esrliestCreatedTime)
-                                        {
-                                            esrliestCreatedTime = tlb[i].tValue;
-                                            replacedTLB = i;
-                                        }
+                                    replacedTLB = first + TLBClockHand[set];
+                                    TLBClockHand[set] = (TLBClockHand[set] + 1) % TLBSetSize;
+                                    if (!tlb[replacedTLB].use)
+                                        break;
+                                    // keep the page's use bit for page replacement
+                                    pageTable->entries[tlb[replacedTLB].physicalPage].use = true;
+                                    tlb[replacedTLB].use = false;
                                 }
-                            tlb[replacedTLB].tValue = machine->timeStamp;  // update created time
                         }
                         break;
                     // case TLB_LFU:
                     //     {
                     //         int minUsedCount = (1 << 30);
-                    //         for (int i = 0; i < TLBSize; ++i)
+                    //         for (int i = first; i < first + TLBSetSize; ++i)
                     //             {
                     //                 if (tlb[i].tValue < minUsedCount)
                     //                     {
@@ -334,14 +429,77 @@ void Machine::TLBMissHandler()
                     default:
                         ASSERT(false);  // unknow replacement strategy
                 }
-            tlb[replacedTLB].virtualPage = vpn;
-            tlb[replacedTLB].physicalPage = physPage;
-            tlb[replacedTLB].valid = true;
-            pageTable[replacedTLB].dirty =
+            if (tlb[replacedTLB].asid == currentASID)
+                InvalidateTranslation(tlb[replacedTLB].virtualPage);
+            pageTable->entries[tlb[replacedTLB].physicalPage].dirty =
                 tlb[replacedTLB].dirty;  // update dirty bit in page table
+            if (tlb[replacedTLB].use)
+                pageTable->entries[tlb[replacedTLB].physicalPage].use = true;
+        }
+
+    tlb[replacedTLB].virtualPage = vpn;
+    tlb[replacedTLB].physicalPage = physPage;
+    tlb[replacedTLB].valid = true;
+    tlb[replacedTLB].use = false;
+    tlb[replacedTLB].dirty = entry->dirty;
+    tlb[replacedTLB].readOnly = entry->readOnly;
+    tlb[replacedTLB].asid = currentASID;
+    tlb[replacedTLB].tValue = ++timeStamp;  // update created (or last used) time
+    return replacedTLB;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateTLBPage
+// 	Invalidate the TLB entry of virtual page "vpn" of address space
+//	"asid", because the page is leaving memory.  Its dirty and use
+//	bits are written back to the page table first.
+//----------------------------------------------------------------------
+
+void Machine::InvalidateTLBPage(int asid, int vpn)
+{
+    if (tlb == NULL)
+        return;
+
+    int first = (vpn % TLBSets) * TLBSetSize;
+    for (int i = first; i < first + TLBSetSize; ++i)
+        {
+            if (tlb[i].valid && tlb[i].asid == asid && tlb[i].virtualPage == vpn)
+                {
+                    if (asid == currentASID)
+                        InvalidateTranslation(vpn);
+                    pageTable->entries[tlb[i].physicalPage].dirty = tlb[i].dirty;
+                    if (tlb[i].use)
+                        pageTable->entries[tlb[i].physicalPage].use = true;
+                    tlb[i].valid = false;
+                    break;
+                }
         }
 }
 
+//----------------------------------------------------------------------
+// Machine::InvalidateTLBSpace
+// 	Invalidate every TLB entry of address space "asid", because it
+//	is being destroyed, or all of its pages are leaving memory.
+//	Dirty bits are written back to the page table first.
+//----------------------------------------------------------------------
+
+void Machine::InvalidateTLBSpace(int asid)
+{
+    if (tlb == NULL)
+        return;
+
+    for (int i = 0; i < TLBEntries; ++i)
+        {
+            if (tlb[i].valid && tlb[i].asid == asid)
+                {
+                    pageTable->entries[tlb[i].physicalPage].dirty = tlb[i].dirty;
+                    tlb[i].valid = false;
+                }
+        }
+    if (asid == currentASID)
+        FlushTranslationCache();
+}
+
 void Machine::PageFaultHandler()
 {
     int badVAddr = ReadRegister(BadVAddrReg);
@@ -349,85 +507,725 @@ void Machine::PageFaultHandler()
     PageLoad(vpn);
 }
 
-int Machine::PageLoad(int vpn)
+//----------------------------------------------------------------------
+// Machine::CopyOnWriteHandler
+// 	The running address space wrote to the page at BadVAddrReg, which
+//	is mapped read-only.  If the page is shared copy-on-write since a
+//	Fork, give the address space a copy of its own, which it may
+//	write; if the others have all made their own copies already, just
+//	let it write the page.  A page that is really read-only is left
+//	alone.
+//----------------------------------------------------------------------
+
+void Machine::CopyOnWriteHandler()
 {
-    int physPage = memStatusMap->Find();
-    if (physPage == -1)  // physical space has been used up, find a page to swap out
+    int badVAddr = ReadRegister(BadVAddrReg);
+    int vpn = (unsigned)badVAddr / PageSize;
+    AddrSpace *space = currentThread->space;
+
+    swapDisk->Throttle();  // we may page out below, so do it first
+    int index = pageTable->Lookup(currentSpaceId, vpn);
+    if (index == -1)  // paged out meanwhile: it faults in unshared
+        return;
+    int physPage = pageTable->entries[index].physicalPage;
+    InvertedTranslationEntry *entry = &pageTable->entries[physPage];
+    if (!entry->copyOnWrite)
+        return;
+
+    InvalidateTLBPage(space->asid, vpn);  // its entry says read-only
+    InvalidateTranslation(vpn);
+    if (coreMap->entries[physPage].refCount == 1)  // nobody to copy it for
         {
-            int swapOutPage = -1;
-            int earliestUsedTime = (1 << 30);
-            for (int i = 0; i < pageTableSize; ++i)
+            entry->readOnly = false;
+            entry->copyOnWrite = false;
+            return;
+        }
+
+    coreMap->Pin(physPage);  // not the one to replace
+    int copy = AllocateFrame(vpn);  // pinned
+    coreMap->Unpin(physPage);
+    bcopy(&mainMemory[physPage * PageSize], &mainMemory[copy * PageSize], PageSize);
+    InvalidateDecodedPage(copy);
+    PageBacking backing = entry->backing;
+    bool dirty = entry->dirty;
+    UnmapPage(index);  // the others keep the page
+
+    pageTable->Map(copy, currentSpaceId, vpn);
+    entry = &pageTable->entries[copy];
+    entry->backing = backing;
+    entry->prefetched = false;
+    entry->dirty = dirty;
+    entry->readOnly = false;
+    entry->copyOnWrite = false;
+    coreMap->Unpin(copy);
+    stats->numPageCopies++;
+    DEBUG('a', "Copy on write: vpn=%d, ppn=%d, copy=%d\n", vpn, physPage, copy);
+}
+
+//----------------------------------------------------------------------
+// Machine::ShareSpace
+// 	Give address space "to", just created by Fork, the pages of
+//	address space "from" (the running one): its pages in memory and
+//	in swap space become shared, through alias entries of the page
+//	tables, so nothing is copied now.  The pages in memory become
+//	read-only; the first write to one, by either address space, gets
+//	the writer a copy of it (see CopyOnWriteHandler).  Pages "from"
+//	never loaded are loaded by "to" on its own, like "from" would.
+//
+//	Only if there is no alias entry left is a page copied right away,
+//	to a page of swap space of its own.
+//
+//	The pages to share are found in the page tables, not by trying
+//	every page of the (mostly unused) address space; the list is made
+//	first, since copying a page may wait for the disk, and let the
+//	pages move between memory and swap space meanwhile.
+//----------------------------------------------------------------------
+
+void Machine::ShareSpace(AddrSpace *from, AddrSpace *to)
+{
+    char *buffer = NULL;
+    int *pages = new int[pageTable->size + pageTable->numAliases +
+                         swapPageTable->size + swapPageTable->numAliases];
+    int numShared = 0;
+
+    numShared += FindPages(pageTable, from->spaceId, pages);
+    numShared += FindPages(swapPageTable, from->spaceId, pages + numShared);
+    for (int i = 0; i < numShared; ++i)
+        {
+            int vpn = pages[i];
+            if (pageTable->Lookup(to->spaceId, vpn) != -1 ||
+                swapPageTable->Lookup(to->spaceId, vpn) != -1)
+                continue;  // already shared, or listed twice
+
+            int index = pageTable->Lookup(from->spaceId, vpn);
+            if (index != -1)
                 {
-                    if (pageTable[i].valid && pageTable[i].tValue < earliestUsedTime)
+                    int physPage = pageTable->entries[index].physicalPage;
+                    InvertedTranslationEntry *entry = &pageTable->entries[physPage];
+                    InvalidateTLBPage(from->asid, vpn);  // it may have been writable
+                    if (from->spaceId == currentSpaceId)
+                        InvalidateTranslation(vpn);
+                    if (!entry->readOnly)
                         {
-                            earliestUsedTime = pageTable[i].tValue;
-                            swapOutPage = i;
+                            entry->readOnly = true;
+                            entry->copyOnWrite = true;
                         }
+                    if (pageTable->MapAlias(physPage, to->spaceId, vpn) != -1)
+                        coreMap->Share(physPage);
+                    else
+                        WriteToSwap(physPage, to->spaceId, vpn);
+                    continue;
                 }
-            ASSERT(swapOutPage >= 0);
-            int swapSpacePage = swapStatusMap->Find();
-            ASSERT(swapSpacePage >= 0);
-            physPage = pageTable[swapOutPage].physicalPage;
-            int swapOutAddrStart = physPage * PageSize, swapAddrStart = swapSpacePage * PageSize;
-            for (int i = 0; i < PageSize; ++i)
-                swapSpace[swapAddrStart + i] = mainMemory[swapOutAddrStart + i];
-            swapPageTable[swapOutPage].virtualPage = swapOutPage;
-            swapPageTable[swapOutPage].physicalPage = swapSpacePage;
-            swapPageTable[swapOutPage].valid = true;
-            swapPageTable[swapOutPage].dirty = pageTable[swapOutPage].dirty;
-            swapPageTable[swapOutPage].readOnly = pageTable[swapOutPage].readOnly;
-            pageTable[swapOutPage].valid = false;
 
+            index = swapPageTable->Lookup(from->spaceId, vpn);
+            if (index != -1)
+                {
+                    int swapSpacePage = swapPageTable->entries[index].physicalPage;
+                    if (swapPageTable->MapAlias(swapSpacePage, to->spaceId, vpn) != -1)
+                        {
+                            swapDisk->SharePage(swapSpacePage);
+                            continue;
+                        }
+                    InvertedTranslationEntry *swapEntry = &swapPageTable->entries[swapSpacePage];
+                    int copy = swapDisk->AllocatePage();
+                    ASSERT(copy >= 0);
+                    if (buffer == NULL)
+                        buffer = new char[PageSize];
+                    swapDisk->ReadPage(swapSpacePage, buffer);
+                    swapDisk->WritePage(copy, buffer);
+                    swapPageTable->Map(copy, to->spaceId, vpn);
+                    swapPageTable->entries[copy].dirty = swapEntry->dirty;
+                    swapPageTable->entries[copy].readOnly = swapEntry->readOnly;
+                    swapPageTable->entries[copy].copyOnWrite = swapEntry->copyOnWrite;
+                }
+        }
+    delete[] pages;
+    delete[] buffer;
+}
+
+//----------------------------------------------------------------------
+// Machine::FindPages
+// 	Put into "pages" the virtual page numbers of the pages of address
+//	space "spaceId" that "table" has entries for, and return how many
+//	there are.
+//----------------------------------------------------------------------
+
+int Machine::FindPages(InvertedPageTable *table, int spaceId, int *pages)
+{
+    int count = 0;
+
+    for (int i = 0; i < table->size + table->numAliases; i++)
+        if (table->entries[i].valid && table->entries[i].tid == spaceId)
+            pages[count++] = table->entries[i].virtualPage;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// Machine::ReleasePage
+// 	Address space "spaceId" is going away, and is done with its page
+//	"vpn".  Free the physical page, or page of swap space, holding
+//	it, unless other address spaces share it.
+//----------------------------------------------------------------------
+
+void Machine::ReleasePage(int spaceId, int vpn)
+{
+    int index = pageTable->Lookup(spaceId, vpn);
+    if (index != -1)
+        {
+            int physPage = pageTable->entries[index].physicalPage;
+            if (!UnmapPage(index))
+                coreMap->Free(physPage);
+        }
+
+    index = swapPageTable->Lookup(spaceId, vpn);
+    if (index != -1)
+        UnmapSwapPage(index);
+}
+
+//----------------------------------------------------------------------
+// Machine::ReleaseSpace
+// 	Address space "spaceId" is going away: release all of its pages,
+//	in memory or in swap space.  Only the pages it has touched are in
+//	the page tables, so they are found there, at a cost that does not
+//	depend on the size of the address space.
+//----------------------------------------------------------------------
+
+void Machine::ReleaseSpace(int spaceId)
+{
+    // releasing a page never hands an entry to "spaceId", so one pass
+    // over each table is enough
+    for (int i = 0; i < pageTable->size + pageTable->numAliases; i++)
+        if (pageTable->entries[i].valid && pageTable->entries[i].tid == spaceId)
+            ReleasePage(spaceId, pageTable->entries[i].virtualPage);
+    for (int i = 0; i < swapPageTable->size + swapPageTable->numAliases; i++)
+        if (swapPageTable->entries[i].valid && swapPageTable->entries[i].tid == spaceId)
+            ReleasePage(spaceId, swapPageTable->entries[i].virtualPage);
+}
+
+//----------------------------------------------------------------------
+// Machine::UnmapPage
+// 	Take entry "index" out of the page table.  Returns FALSE if that
+//	was the last mapping of its physical page, which the caller must
+//	then free or reuse.  Otherwise the page stays in use by the other
+//	address spaces sharing it; if "index" was the page's own entry,
+//	one of them takes it over.
+//----------------------------------------------------------------------
+
+bool Machine::UnmapPage(int index)
+{
+    int physPage = pageTable->entries[index].physicalPage;
+
+    if (coreMap->entries[physPage].refCount == 1)
+        {
+            pageTable->Unmap(index);
+            return FALSE;
+        }
+    if (index == physPage)
+        coreMap->Unshare(physPage, AddrSpace::Lookup(pageTable->ReplaceWithAlias(index)));
+    else
+        {
+            pageTable->Unmap(index);
+            coreMap->Unshare(physPage, coreMap->entries[physPage].owner);
+        }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::UnmapSwapPage
+// 	Take entry "index" out of the swap page table, and give back its
+//	page of swap space, which is freed unless other address spaces
+//	share it.
+//----------------------------------------------------------------------
+
+void Machine::UnmapSwapPage(int index)
+{
+    int swapSpacePage = swapPageTable->entries[index].physicalPage;
+
+    if (index == swapSpacePage && swapDisk->IsShared(swapSpacePage))
+        swapPageTable->ReplaceWithAlias(index);
+    else
+        swapPageTable->Unmap(index);
+    swapDisk->FreePage(swapSpacePage);
+}
+
+//----------------------------------------------------------------------
+// Machine::ChooseVictimFrame
+// 	Choose a physical page to replace, with the clock (second chance)
+//	algorithm.  The hand sweeps over all of physical memory, whoever
+//	the pages belong to; a page referenced since the hand last passed
+//	has its use bit cleared and is skipped.  A page is referenced if
+//	the use bit of its page table entry, or of its TLB entry, is set.
+//	Free and pinned pages are passed over.  Returns -1 if two sweeps
+//	find nothing to replace: every page in use is pinned.
+//
+//	If "owner" is not NULL, only its pages are considered (local
+//	replacement, see MemoryScheduler).
+//----------------------------------------------------------------------
+
+int Machine::ChooseVictimFrame(AddrSpace *owner)
+{
+    for (int n = 0; n < 2 * NumPhysPages; ++n)
+        {
+            int frame = clockHand;
+            InvertedTranslationEntry *entry = &pageTable->entries[frame];
+            clockHand = (clockHand + 1) % NumPhysPages;
+
+            if (coreMap->entries[frame].owner == NULL)  // freed by the daemon
+                continue;
+            if (owner != NULL && coreMap->entries[frame].owner != owner)
+                continue;
+            if (coreMap->entries[frame].pinned)  // maybe not loaded yet
+                continue;
+            ASSERT(entry->valid);
+            bool used = entry->use;
+            entry->use = false;
             if (tlb != NULL)
                 {
-                    for (int i = 0; i < TLBSize; ++i)
-                        if (tlb[i].valid && tlb[i].virtualPage == swapOutPage)
+                    int first = (entry->virtualPage % TLBSets) * TLBSetSize;
+                    for (int i = first; i < first + TLBSetSize; ++i)
+                        if (tlb[i].valid && tlb[i].physicalPage == frame)
                             {
-                                tlb[i].valid = false;
-                                break;
+                                used = used || tlb[i].use;
+                                tlb[i].use = false;
                             }
                 }
+            if (used && entry->prefetched)
+                {
+                    entry->prefetched = false;
+                    AdaptFaultAround(true);
+                }
+            if (!used)
+                return frame;
+        }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::PageOut
+// 	Remove physical page "physPage" from the page table and from the
+//	TLB, copying it out to swap space unless it can be read back from
+//	the executable (it was loaded from there and is still clean).  The
+//	page may belong to any address space, as recorded in the core map.
+//	The caller frees (or reuses) the physical page.
+//
+//	The write to the swap disk is only queued (see SwapDisk), so we
+//	never wait for it.  A dirty page of a file mapped by Mmap is
+//	written back to the file instead, which may wait.
+//
+//	A page shared after a Fork is taken away from every address space
+//	sharing it; they share the page of swap space instead.
+//----------------------------------------------------------------------
+
+void Machine::PageOut(int physPage)
+{
+    InvertedTranslationEntry *entry = &pageTable->entries[physPage];
+    AddrSpace *owner = coreMap->entries[physPage].owner;
+    int vpn = entry->virtualPage;
+    int swapSpacePage = -1;
 
-            printf("Page Swap Out: vpn=%d, ppn=%d, spn=%d\n", swapOutPage, physPage, swapSpacePage);
+    ASSERT(owner != NULL && coreMap->entries[physPage].virtualPage == vpn);
+    InvalidateTLBPage(owner->asid, vpn);  // gets the dirty bit too
+    if (entry->tid == currentSpaceId)
+        InvalidateTranslation(vpn);
+    if (entry->prefetched)
+        AdaptFaultAround(entry->use);
+    if (entry->backing != Anonymous && !entry->dirty)
+        DEBUG('a', "Page Discard: vpn=%d, ppn=%d\n", vpn, physPage);
+    else if (entry->backing == MappedFile)  // back to its file, not to swap
+        {
+            AddrSpace::Lookup(entry->tid)->WriteMappedPage(vpn, &mainMemory[physPage * PageSize]);
+            DEBUG('a', "Page write back: vpn=%d, ppn=%d\n", vpn, physPage);
+        }
+    else
+        {
+            swapSpacePage = WriteToSwap(physPage, entry->tid, vpn);
+            printf("Page Swap Out: vpn=%d, ppn=%d, spn=%d\n", vpn, physPage, swapSpacePage);
         }
 
+    // the other address spaces sharing the page lose it too
+    int alias;
+    while (coreMap->entries[physPage].refCount > 1 &&
+           (alias = pageTable->FindAlias(physPage)) != -1)
+        {
+            int tid = pageTable->entries[alias].tid;
+            InvalidateTLBPage(AddrSpace::Lookup(tid)->asid, vpn);
+            if (tid == currentSpaceId)
+                InvalidateTranslation(vpn);
+            pageTable->Unmap(alias);
+            if (swapSpacePage == -1)
+                continue;
+            if (swapPageTable->MapAlias(swapSpacePage, tid, vpn) != -1)
+                swapDisk->SharePage(swapSpacePage);
+            else  // no alias entry left: give it a copy of its own
+                WriteToSwap(physPage, tid, vpn);
+        }
+    pageTable->Unmap(physPage);
+}
+
+//----------------------------------------------------------------------
+// Machine::WriteToSwap
+// 	Copy physical page "physPage" to a free page of swap space, which
+//	then holds virtual page "vpn" of address space "tid", with the
+//	bits of the physical page.  Returns the page of swap space.
+//----------------------------------------------------------------------
+
+int Machine::WriteToSwap(int physPage, int tid, int vpn)
+{
+    InvertedTranslationEntry *entry = &pageTable->entries[physPage];
+    int swapSpacePage = swapDisk->AllocatePage();
+
+    ASSERT(swapSpacePage >= 0);
+    swapDisk->WritePage(swapSpacePage, &mainMemory[physPage * PageSize]);
+    swapPageTable->Map(swapSpacePage, tid, vpn);
+    swapPageTable->entries[swapSpacePage].dirty = entry->dirty;
+    swapPageTable->entries[swapSpacePage].readOnly = entry->readOnly;
+    swapPageTable->entries[swapSpacePage].copyOnWrite = entry->copyOnWrite;
+    return swapSpacePage;
+}
+
+//----------------------------------------------------------------------
+// Machine::PageLoad
+// 	Bring virtual page "vpn" of the current address space into
+//	physical memory, replacing another page if memory is full, and
+//	enter it in the page table.  Returns the physical page.
+//
+//	The medium-term scheduler sees every fault first, and may keep
+//	us waiting, swapped out, until there is room in memory for us.
+//
+//	Reading the page from the swap disk makes us wait, and other
+//	threads run (and fault) meanwhile, so the frame is pinned until
+//	the page is in.
+//
+//	A page of swap space shared after a Fork is read in for us alone:
+//	the others keep sharing the swap page, and ours is no longer
+//	copy-on-write.  A text page that another address space running
+//	the same program has in memory is just shared (see ShareText).
+//----------------------------------------------------------------------
+
+int Machine::PageLoad(int vpn)
+{
+    InvertedTranslationEntry *entry;
+    AddrSpace *space = currentThread->space;
+
+    memScheduler->PageFault(space);
+    swapDisk->Throttle();  // don't let page-outs pile up
+    int physPage = ShareText(vpn);
+    if (physPage != -1)
+        {
+            stats->numPageFaults++;
+            DEBUG('a', "Page shared text: vpn=%d, ppn=%d\n", vpn, physPage);
+            return physPage;
+        }
+    physPage = AllocateFrame(vpn);  // pinned until the page is in
+    stats->numPageFaults++;
+
+    PageBacking backing;
+    bool dirty, readOnly;
     int physAddrStart = physPage * PageSize;
-    if (swapPageTable[vpn].valid)  // file in swap space
-        {
-            int swapAddrStart = swapPageTable[vpn].physicalPage * PageSize;
-            for (int i = 0; i < PageSize; ++i)
-                mainMemory[physAddrStart + i] = swapSpace[swapAddrStart + i];
-            pageTable[vpn].dirty = swapPageTable[vpn].dirty;
-            pageTable[vpn].readOnly = swapPageTable[vpn].readOnly;
-            swapPageTable[vpn].valid = false;
-            swapStatusMap->Clear(swapPageTable[vpn].physicalPage);
+    int swapIndex = swapPageTable->Lookup(currentSpaceId, vpn);
+    if (swapIndex != -1)  // file in swap space
+        {
+            int swapSpacePage = swapPageTable->entries[swapIndex].physicalPage;
+            InvertedTranslationEntry *swapEntry = &swapPageTable->entries[swapSpacePage];
+            swapDisk->ReadPage(swapSpacePage, &mainMemory[physAddrStart]);
+            backing = Anonymous;  // its only other copy is gone
+            dirty = swapEntry->dirty;
+            readOnly = swapEntry->readOnly && !swapEntry->copyOnWrite;
+            UnmapSwapPage(swapPageTable->Lookup(currentSpaceId, vpn));
             printf("Page load from swap space: vpn=%d, ppn=%d, spn=%d\n", vpn, physPage,
-                   swapPageTable[vpn].physicalPage);
+                   swapSpacePage);
+        }
+    else if (space->FindMapping(vpn) != NULL)  // mapped file
+        {
+            space->ReadMappedPage(vpn, &mainMemory[physAddrStart]);
+            backing = MappedFile;
+            dirty = false;
+            readOnly = false;
+            DEBUG('a', "Page load from mapped file: vpn=%d, ppn=%d\n", vpn, physPage);
+        }
+    else if (space->IsZeroFill(vpn))  // bss or stack
+        {
+            memset(&mainMemory[physAddrStart], 0, PageSize);
+            backing = ZeroFill;
+            dirty = false;
+            readOnly = false;
+            DEBUG('a', "Page zero-fill: vpn=%d, ppn=%d\n", vpn, physPage);
         }
     else  // file in disk
         {
-            ASSERT(execFile != NULL);
-            execFile->ReadAt(&(mainMemory[physAddrStart]), PageSize,
-                             (char *)(vpn * PageSize + offsetVaddrToFile));
-            pageTable[vpn].dirty = false;
-            pageTable[vpn].readOnly =
-                (vpn >= readOnlyPageStart && vpn < readOnlyPageEnd) ? true : false;
+            LoadFromFile(vpn, physPage);
+            backing = FileBacked;
+            dirty = false;
+            readOnly = (vpn >= readOnlyPageStart && vpn < readOnlyPageEnd) ? true : false;
             printf("Page load from disk: vpn=%d, ppn=%d\n", vpn, physPage);
         }
-    pageTable[vpn].virtualPage = vpn;
-    pageTable[vpn].physicalPage = physPage;
-    pageTable[vpn].valid = true;
+    InvalidateDecodedPage(physPage);  // the frame holds a different page now
+    pageTable->Map(physPage, currentSpaceId, vpn);
+    entry = &pageTable->entries[physPage];
+    entry->backing = backing;
+    entry->prefetched = false;
+    entry->dirty = dirty;
+    entry->readOnly = readOnly;
+    entry->copyOnWrite = false;
+    if (backing == FileBacked && readOnly)  // text: let others share it
+        coreMap->CacheText(physPage, space->execFileId);
+    coreMap->Unpin(physPage);
+
+    return physPage;
+}
+
+//----------------------------------------------------------------------
+// Machine::ShareText
+// 	If virtual page "vpn" of the current address space is a page of
+//	text (read-only, and read from the executable), and another
+//	address space running the same executable has it in memory, map
+//	that physical page for us too, through an alias entry of the page
+//	table.  Returns the physical page, or -1 if the page must be
+//	loaded.
+//----------------------------------------------------------------------
+
+int Machine::ShareText(int vpn)
+{
+    if (vpn < readOnlyPageStart || vpn >= readOnlyPageEnd ||
+        swapPageTable->Lookup(currentSpaceId, vpn) != -1)
+        return -1;
+
+    int physPage = coreMap->FindText(currentThread->space->execFileId, vpn);
+    if (physPage == -1 || pageTable->MapAlias(physPage, currentSpaceId, vpn) == -1)
+        return -1;
+    coreMap->Share(physPage);
+    return physPage;
+}
 
-    switch (PTReplaceStrategy)
+//----------------------------------------------------------------------
+// Machine::AllocateFrame
+// 	Find a physical page to hold virtual page "vpn" of the current
+//	address space: normally a free one, kept available by the
+//	page-out daemon; or else, if the daemon has fallen behind, one
+//	whose page we replace ourselves.  The page is returned pinned.
+//
+//	An address space at its resident set limit replaces one of its
+//	own pages instead, if it can.
+//
+//	Other threads may run meanwhile (the daemon, if we wake it up),
+//	so the caller must not have anything half done.
+//----------------------------------------------------------------------
+
+int Machine::AllocateFrame(int vpn)
+{
+    AddrSpace *space = currentThread->space;
+    int physPage = -1;
+
+    if (memScheduler->OverLimit(space))  // replace one of our own pages
+        physPage = ChooseVictimFrame(space);
+    if (physPage != -1)
+        stats->numLocalPageOuts++;
+    else
         {
-            case PT_FIFO:
+            physPage = coreMap->Allocate(space, vpn);
+            if (physPage == -1)  // physical space has been used up, find a page to swap out
                 {
-                    pageTable[vpn].tValue = timeStamp;
+                    physPage = ChooseVictimFrame();
+                    ASSERT(physPage != -1);  // not every page may be pinned
+                    stats->numFaultPageOuts++;
                 }
+        }
+    bool replace = pageTable->entries[physPage].valid;
+    coreMap->Pin(physPage);  // nobody else may pick it meanwhile
+    if (replace)
+        {
+            PageOut(physPage);
+            coreMap->Assign(physPage, space, vpn);
+        }
+    pageOutDaemon->FramesTaken();
+    return physPage;
+}
+
+//----------------------------------------------------------------------
+// Machine::LoadFromFile
+// 	Read virtual page "vpn" of the current address space from the
+//	executable into physical page "physPage".
+//
+//	With fault-around, the pages that follow it in the file are read
+//	by the same ReadAt, up to faultAroundWindow pages in all, and
+//	entered in the page table right away.  We stop at the first page
+//	that is already resident or in swap space, or has nothing in the
+//	executable (see AddrSpace::IsZeroFill), or is text another address
+//	space has in memory, and when no physical page is free, or the
+//	address space is at its resident set limit: we never replace a
+//	page to prefetch another.
+//----------------------------------------------------------------------
+
+void Machine::LoadFromFile(int vpn, int physPage)
+{
+    AddrSpace *space = currentThread->space;
+    int *frames = new int[max(faultAroundWindow, 1)];
+    int count = 1;
+
+    frames[0] = physPage;
+    while (count < faultAroundWindow && vpn + count < (int)pageTableSize &&
+           !space->IsZeroFill(vpn + count) &&
+           pageTable->Lookup(currentSpaceId, vpn + count) == -1 &&
+           swapPageTable->Lookup(currentSpaceId, vpn + count) == -1 &&
+           coreMap->FindText(space->execFileId, vpn + count) == -1 &&
+           !memScheduler->OverLimit(space))
+        {
+            int frame = coreMap->Allocate(space, vpn + count);
+            if (frame == -1)
                 break;
+            coreMap->Pin(frame);  // the read may wait for the disk
+            frames[count++] = frame;
         }
+    if (count > 1)
+        pageOutDaemon->FramesTaken();  // like AllocateFrame, for the others
 
-    return physPage;
+    char *buffer = (count == 1) ? &mainMemory[physPage * PageSize] : new char[count * PageSize];
+    space->ReadPages(vpn, count, buffer);
+    if (count > 1)
+        {
+            for (int k = 0; k < count; ++k)
+                bcopy(&buffer[k * PageSize], &mainMemory[frames[k] * PageSize], PageSize);
+            delete[] buffer;
+        }
+
+    for (int k = 1; k < count; ++k)
+        {
+            int page = vpn + k;
+            InvalidateDecodedPage(frames[k]);
+            pageTable->Map(frames[k], currentSpaceId, page);
+            InvertedTranslationEntry *entry = &pageTable->entries[frames[k]];
+            entry->backing = FileBacked;
+            entry->prefetched = true;
+            entry->dirty = false;
+            entry->readOnly = (page >= readOnlyPageStart && page < readOnlyPageEnd) ? true : false;
+            entry->copyOnWrite = false;
+            if (entry->readOnly)
+                coreMap->CacheText(frames[k], space->execFileId);
+            coreMap->Unpin(frames[k]);
+            DEBUG('a', "Page prefetch from disk: vpn=%d, ppn=%d\n", page, frames[k]);
+        }
+    delete[] frames;
+}
+
+//----------------------------------------------------------------------
+// Machine::SetFaultAround
+// 	Read up to "pages" pages of the executable at a time, starting
+//	at the faulting page; 0 or 1 turns fault-around off.
+//----------------------------------------------------------------------
+
+void Machine::SetFaultAround(int pages)
+{
+    ASSERT(pages >= 0);
+    faultAroundMax = pages;
+    faultAroundWindow = pages;
+}
+
+//----------------------------------------------------------------------
+// Machine::AdaptFaultAround
+// 	A prefetched page was found to have been "used", or is being
+//	replaced without ever having been used.  Grow the fault-around
+//	window by a page in the first case, halve it in the second.
+//----------------------------------------------------------------------
+
+void Machine::AdaptFaultAround(bool used)
+{
+    if (used)
+        faultAroundWindow = min(faultAroundWindow + 1, faultAroundMax);
+    else
+        faultAroundWindow = max(faultAroundWindow / 2, 1);
+    DEBUG('a', "Fault-around window now %d pages\n", faultAroundWindow);
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateDecodedPage
+// 	Forget every predecoded instruction and all the threaded code of
+//	physical page "physPage".  Must be called whenever the contents of
+//	the frame are replaced behind the back of WriteMem (page load,
+//	swap in).
+//----------------------------------------------------------------------
+
+void Machine::InvalidateDecodedPage(int physPage)
+{
+    int first = physPage * PageSize / 4;
+    ThreadedOp *op = &threadedCode[ThreadedSlot(physPage * PageSize)];
+    for (int i = 0; i < PageSize / 4; ++i)
+        {
+            decodeValid[first + i] = FALSE;
+            op[i].handler = NULL;
+        }
+    translationEpoch++;
+}
+
+//----------------------------------------------------------------------
+// Machine::StartTrace
+// 	Record every page referenced through Translate, from now on, in
+//	host file "name" (see pagetrace.h, and bin/pagesim for replaying
+//	the trace).  With the threaded-code engine, instructions are only
+//	translated once per basic block, so use the switch engine to
+//	trace instruction fetches.
+//----------------------------------------------------------------------
+
+void Machine::StartTrace(char *name)
+{
+    TraceHeader header;
+
+    ASSERT(traceFile == -1);
+    traceFile = OpenForWrite(name);
+    traceBuffer = new unsigned int[TraceBufferSize];
+    traceCount = 0;
+    traceLast = 0;
+    traceReferences = 0;
+    header.traceMagic = TRACEMAGIC;
+    header.pageSize = PageSize;
+    header.references = 0;  // filled in by StopTrace
+    WriteFile(traceFile, (char *)&header, sizeof(header));
+}
+
+//----------------------------------------------------------------------
+// Machine::TraceReference
+// 	Record a reference to virtual page "vpn" of the running address
+//	space, unless it repeats the last one recorded.  Records are
+//	written out TraceBufferSize at a time.
+//----------------------------------------------------------------------
+
+void Machine::TraceReference(int vpn, bool writing)
+{
+    unsigned int record = TraceRecord(currentSpaceId, vpn, writing);
+
+    traceReferences++;
+    if (record == traceLast && traceReferences > 1)
+        return;
+    traceLast = record;
+    traceBuffer[traceCount++] = record;
+    if (traceCount == TraceBufferSize)
+        {
+            WriteFile(traceFile, (char *)traceBuffer, traceCount * sizeof(unsigned int));
+            traceCount = 0;
+        }
+}
+
+//----------------------------------------------------------------------
+// Machine::StopTrace
+// 	Write out the records still buffered, and the number of
+//	references traced, and close the trace.
+//----------------------------------------------------------------------
+
+void Machine::StopTrace()
+{
+    if (traceFile == -1)
+        return;
+
+    TraceHeader header;
+
+    WriteFile(traceFile, (char *)traceBuffer, traceCount * sizeof(unsigned int));
+    header.traceMagic = TRACEMAGIC;
+    header.pageSize = PageSize;
+    header.references = traceReferences;
+    Lseek(traceFile, 0, 0);
+    WriteFile(traceFile, (char *)&header, sizeof(header));
+    Close(traceFile);
+    delete[] traceBuffer;
+    traceFile = -1;
 }
 
 void Machine::printTLBStat()
@@ -436,26 +1234,44 @@ void Machine::printTLBStat()
     printf("Hitting rate: %.5f\n", (float)TLBHitCount / (float)(TLBHitCount + TLBMissCount));
 }
 
+//----------------------------------------------------------------------
+// Machine::printEngineStat
+// 	Print how fast user instructions were simulated, in millions of
+//	simulated instructions per second of host time.
+//----------------------------------------------------------------------
+
+void Machine::printEngineStat()
+{
+    if (hostStartTime == 0)  // no user program was run
+        return;
+
+    double seconds = HostTime() - hostStartTime;
+    int instructions = stats->userTicks / UserTick;
+
+    printf("Engine: %s, %d instructions in %.3f seconds", useThreadedCode ? "threaded" : "switch",
+           instructions, seconds);
+    if (seconds > 0)
+        printf(", %.2f simulated MIPS", instructions / seconds / 1e6);
+    printf("\n");
+}
+
+//----------------------------------------------------------------------
+// Machine::SwapOut
+// 	Page out every page of the current address space, to suspend it
+//	(see MemoryScheduler).  Pages being loaded or paged out already
+//	are pinned, and left alone.
+//----------------------------------------------------------------------
+
 void Machine::SwapOut()
 {
-    for (int i = 0; i < pageTableSize; ++i)
+    for (int i = 0; i < NumPhysPages; ++i)
         {
-            if (pageTable[i].valid)
+            if (coreMap->entries[i].owner == currentThread->space && !coreMap->entries[i].pinned)
                 {
-                    int swapSpacePage = swapStatusMap->Find();
-                    ASSERT(swapSpacePage >= 0);
-                    int physPage = pageTable[i].physicalPage;
-                    int swapOutAddrStart = physPage * PageSize,
-                        swapAddrStart = swapSpacePage * PageSize;
-                    for (int j = 0; j < PageSize; ++j)
-                        swapSpace[swapAddrStart + j] = mainMemory[swapOutAddrStart + j];
-                    swapPageTable[i].virtualPage = i;
-                    swapPageTable[i].physicalPage = swapSpacePage;
-                    swapPageTable[i].valid = true;
-                    swapPageTable[i].dirty = pageTable[i].dirty;
-                    swapPageTable[i].readOnly = pageTable[i].readOnly;
-                    pageTable[i].valid = false;
-                    memStatusMap->Clear(physPage);
+                    coreMap->Pin(i);
+                    PageOut(i);
+                    coreMap->Unpin(i);
+                    coreMap->Free(i);
                 }
         }
-}
\ No newline at end of file
+}
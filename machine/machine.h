@@ -26,23 +26,37 @@
 #include "translate.h"
 #include "disk.h"
 #include "bitmap.h"
+#include "coremap.h"
+
+class SwapDisk;
+class PageOutDaemon;
+class MemoryScheduler;
 
 // Definitions related to the size, and format of user memory
 
-#define PageSize 	SectorSize 	// set the page size equal to
-					// the disk sector size, for
-					// simplicity
+// These are chosen at startup (see Initialize in system.cc), before the
+// machine is created; by default the page size is equal to the disk
+// sector size, for simplicity.
 
-#define NumPhysPages    32
+extern int PageSize;		// bytes per page, a multiple of 4
+extern int NumPhysPages;	// pages of main memory
+extern int NumSwapPages;	// pages of swap space
 #define MemorySize 	(NumPhysPages * PageSize)
-#define NumSwapPages 1024
-#define SwapSize  (NumSwapPages * PageSize)
 #define TLBSize		4		// if there is a TLB, make it small
+					// (default, see SetTLBGeometry)
+#define NumASIDs	64		// address spaces the TLB can tell apart
+#define NoASID		-1		// tag of an address space that got none;
+					// its TLB entries are flushed when it
+					// is switched out
+#define TranslationCacheSize 64	// host-side cache in Translate,
+					// must be a power of two
+#define TraceBufferSize	1024		// page references buffered before
+					// being written to the trace
 #define TLB_LRU 0
 #define TLB_FIFO 1
 // #define TLB_LFU 2
-#define PT_LRU 0
-#define PT_FIFO 1
+#define TLB_RANDOM 3
+#define TLB_CLOCK 4
 
 enum ExceptionType { NoException,           // Everything ok!
 		     SyscallException,      // A program executed a system call.
@@ -99,6 +113,23 @@ class Instruction {
                      // Immediates are sign-extended.
 };
 
+// The following class defines one instruction of threaded code, as run
+// by the threaded-code engine (threaded.cc): the address of the code that
+// executes the instruction, and its operands, already extracted.
+
+class ThreadedOp {
+  public:
+    void *handler;   // Where to jump to execute the instruction; NULL if
+                     // the word has not been translated (or has changed)
+    int extra;       // Immediate or target or shamt field or offset.
+    unsigned char rs, rt, rd; // Three registers from instruction.
+};
+
+// Threaded code is kept per word of main memory, plus one slot per page
+// that is never translated, so that running off the end of a page
+// always stops the engine.
+#define ThreadedSlot(physAddr)	((physAddr) / 4 + (physAddr) / PageSize)
+
 // The following class defines the simulated host workstation hardware, as 
 // seen by user programs -- the CPU registers, main memory, etc.
 // User programs shouldn't be able to tell that they are running on our 
@@ -120,6 +151,8 @@ class Machine {
 
 // Routines callable by the Nachos kernel
     void Run();	 		// Run a user program
+    void RunThreaded();		// Run a user program with the threaded-code
+				// engine (called by Run)
 
     int ReadRegister(int num);	// read the contents of a CPU register
 
@@ -132,6 +165,18 @@ class Machine {
 
     void OneInstruction(Instruction *instr); 	
     				// Run one instruction of a user program.
+    bool FetchInstruction(int addr, Instruction *instr);
+				// Fetch and decode the instruction at
+				// "addr", using the predecoded copy if
+				// there is one.  Return FALSE if the
+				// translation failed.
+    void InvalidateDecodedPage(int physPage);
+				// Drop the predecoded instructions and
+				// threaded code of a physical page whose
+				// contents changed
+    void TranslateBlock(int physAddr, void **handlers);
+				// Translate the basic block at "physAddr"
+				// into threaded code
     void DelayedLoad(int nextReg, int nextVal);  	
 				// Do a pending delayed load (modifying a reg)
     
@@ -140,6 +185,17 @@ class Machine {
     				// Read or write 1, 2, or 4 bytes of virtual 
 				// memory (at addr).  Return FALSE if a 
 				// correct translation couldn't be found.
+
+    bool CopyIn(int virtAddr, char *into, int size);
+    bool CopyOut(char *from, int virtAddr, int size);
+				// Copy "size" bytes between the running
+				// address space and a kernel buffer, a page
+				// at a time, faulting pages in as needed.
+				// Return FALSE if a page can't be accessed.
+    int CopyInString(int virtAddr, char *into, int maxSize);
+				// Same for a null-terminated string of at
+				// most "maxSize" bytes; return its length,
+				// or -1
     
     ExceptionType Translate(int virtAddr, int* physAddr, int size,bool writing);
     				// Translate an address, and check for 
@@ -148,6 +204,15 @@ class Machine {
     				// and return an exception code if the 
 				// translation couldn't be completed.
 
+    void FlushTranslationCache();
+				// Forget every cached translation; must be
+				// called when the TLB or page table is
+				// switched or cleared
+    void InvalidateTranslation(int vpn);
+				// Forget the cached translation of virtual
+				// page "vpn", whose TLB or page table entry
+				// is being changed or invalidated
+
     void RaiseException(ExceptionType which, int badVAddr);
 				// Trap to the Nachos kernel, because of a
 				// system call or other exception.  
@@ -155,13 +220,77 @@ class Machine {
     void Debugger();		// invoke the user program debugger
     void DumpState();		// print the user CPU and memory state
 
+    void SetTLBGeometry(int entries, int ways);
+				// Make the TLB "entries" large and "ways"
+				// way set-associative (fully associative
+				// if "ways" is 0); empties the TLB
     void TLBMissHandler();
+    int RefillTLB(int vpn, int physPage);
+				// Put the translation of resident page
+				// "vpn" into the TLB, return its entry
+    void InvalidateTLBPage(int asid, int vpn);
+				// Shoot down the TLB entry of page "vpn"
+				// of address space "asid", if any
+    void InvalidateTLBSpace(int asid);
+				// Shoot down every TLB entry of address
+				// space "asid"
     void PageFaultHandler();
+    void SetFaultAround(int pages);
+				// Read up to "pages" pages of the executable
+				// on a fault (none besides the faulting
+				// page if "pages" is 0 or 1)
+
+    void CopyOnWriteHandler();	// give the running address space its own
+				// copy of a page it shares, on a write
+    void ShareSpace(AddrSpace *from, AddrSpace *to);
+				// give "to" the pages of "from", shared
+				// copy-on-write (Fork)
+    void ReleasePage(int spaceId, int vpn);
+				// address space "spaceId" is done with
+				// page "vpn"; free what holds it, unless
+				// it is shared
+    void ReleaseSpace(int spaceId);
+				// release all the pages of address space
+				// "spaceId", which is going away
 
     int PageLoad(int vpn);
-    void SwapOut();
+    int ShareText(int vpn);	// map page "vpn" of the text of the
+				// current address space's program, if
+				// another address space has it in memory
+    int AllocateFrame(int vpn);	// find a physical page for page "vpn"
+				// of the current address space, and pin it
+    void LoadFromFile(int vpn, int physPage);
+				// read page "vpn", and with fault-around
+				// the pages after it, from the executable
+    int ChooseVictimFrame(AddrSpace *owner = NULL);
+				// physical page to replace next, among
+				// those of "owner" if not NULL; -1 if
+				// all are pinned
+    void PageOut(int physPage);	// move a physical page to swap space
+    int WriteToSwap(int physPage, int tid, int vpn);
+				// copy a physical page to a new page of
+				// swap space, as page "vpn" of "tid"
+    bool UnmapPage(int index);	// drop page table entry "index"; FALSE if
+				// its physical page is now unused
+    void UnmapSwapPage(int index);
+				// same for swap, freeing the swap page
+				// if it is now unused
+    int TranslateForCopy(int virtAddr, bool writing);
+				// physical address of "virtAddr", faulting
+				// it in; -1 if it is read-only
+    int FindPages(InvertedPageTable *table, int spaceId, int *pages);
+				// list the pages of "spaceId" that
+				// "table" holds; return how many
+    void SwapOut();		// page out all of the current address
+				// space, which is being suspended
+
+    void StartTrace(char *name);	// record the pages referenced
+				// through Translate in file "name"
+    void StopTrace();		// finish the trace, if any
 
     void printTLBStat();
+    void printEngineStat();	// print simulated instructions per host
+				// second, for comparing the engines
 
     // Data structures -- all of these are accessible to Nachos kernel code.
     // "public" for convenience.
@@ -171,11 +300,27 @@ class Machine {
 
     char *mainMemory;		// physical memory to store user program,
 				// code and data, while executing
-    BitMap *memStatusMap;   // bitmap to physical pages status
-    char *swapSpace;    // swap space in disk
-    BitMap *swapStatusMap;  // bitmap to swap space
+    CoreMap *coreMap;       // owner and virtual page of each physical page
+    SwapDisk *swapDisk;     // swap space, on its own simulated disk
+    PageOutDaemon *pageOutDaemon;  // keeps some physical pages free
+    MemoryScheduler *memScheduler;  // resident set limits, and swapping
+                                    // of whole address spaces
+    BitMap *asidStatusMap;  // bitmap to address space IDs
     int registers[NumTotalRegs];  // CPU registers, for executing user programs
 
+    Instruction *decodeCache;	// predecoded instructions, one slot per
+				// word of mainMemory
+    bool *decodeValid;		// is the slot in decodeCache up to date?
+    ThreadedOp *threadedCode;	// threaded code, see ThreadedSlot
+    int translationEpoch;	// incremented whenever a frame gets new
+				// contents; threaded code being run must
+				// then look up its block again
+    bool useThreadedCode;	// run user programs with RunThreaded
+    bool hardwareWalker;	// on a TLB miss for a page in memory,
+				// refill the TLB without trapping
+    bool batchTicks;		// between interrupts, advance the clock
+				// without calling Interrupt::OneTick
+
 
     // NOTE: the hardware translation of virtual addresses in the user program
     // to physical addresses (relative to the beginning of "mainMemory")
@@ -197,17 +342,20 @@ class Machine {
 
     TranslationEntry *tlb;		// this pointer should be considered 
 					// "read-only" to Nachos kernel code
+    int TLBEntries;		// number of entries in the TLB
+    int TLBWays;		// associativity asked for, 0 if fully
+				// associative
     int TLBReplaceStrategy;
-    int PTReplaceStrategy;
-
-    TranslationEntry *pageTable;
-    unsigned int pageTableSize;
+    int currentASID;		// tag of the running address space's
+				// TLB entries
 
-    TranslationEntry *swapPageTable;
-    unsigned int swapPageTableSize;
+    InvertedPageTable *pageTable;	// which page of which address space
+					// each physical page holds
+    InvertedPageTable *swapPageTable;	// same, for each page of swap space
+    int currentSpaceId;			// the running address space, as
+					// known to the page tables
+    unsigned int pageTableSize;		// its size, in pages
 
-    OpenFile *execFile;
-    int offsetVaddrToFile;
     int readOnlyPageStart;
     int readOnlyPageEnd;
 
@@ -216,7 +364,37 @@ class Machine {
 				// simulated instruction
     int runUntilTime;		// drop back into the debugger when simulated
 				// time reaches this value
-    int timeStamp;              // timestamp for LRU replacement algorithm
+    int timeStamp;              // timestamp for TLB replacement algorithms,
+                                // advanced on TLB hits and refills
+    int clockHand;		// next physical page to look at, for
+				// ChooseVictimFrame
+    int faultAroundMax;		// largest fault-around window, in pages
+    int faultAroundWindow;	// current window: shrinks when prefetched
+				// pages are replaced unreferenced, grows
+				// back when they turn out to be used
+    void AdaptFaultAround(bool used);
+				// adjust faultAroundWindow, now that we
+				// know whether a prefetched page was used
+    int TLBSets;		// the TLB is split into TLBSets sets
+    int TLBSetSize;		// of TLBSetSize entries; virtual page vpn
+				// can only be in set vpn % TLBSets
+    int *TLBClockHand;		// next entry to look at, per set, for
+				// TLB_CLOCK
+    TranslationCacheEntry translationCache[TranslationCacheSize];
+				// recent translations, indexed by
+				// vpn % TranslationCacheSize
+    void TraceReference(int vpn, bool writing);
+				// record a reference to page "vpn" of
+				// the running address space
+    int traceFile;		// the trace, -1 if not tracing
+    unsigned int *traceBuffer;	// records not written out yet
+    int traceCount;		// number of them
+    unsigned int traceLast;	// the last record
+    unsigned int traceReferences;  // references traced so far
+    double hostStartTime;	// host time when a user program first ran
+    int exceptionCount;		// number of exceptions raised so far; the
+				// kernel may have scheduled interrupts
+				// if it changes
 
     int TLBHitCount;
     int TLBMissCount;
@@ -16,8 +16,6 @@
 #include "mipssim.h"
 #include "system.h"
 
-static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
-
 //----------------------------------------------------------------------
 // Machine::Run
 // 	Simulate the execution of a user-level program on Nachos.
@@ -25,20 +23,41 @@ static void Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr);
 //
 //	This routine is re-entrant, in that it can be called multiple
 //	times concurrently -- one for each thread executing user code.
+//
+//	With batchTicks, OneTick is only called when an interrupt may be
+//	due, or after an exception (the kernel may have scheduled one);
+//	otherwise we just advance the clock, as OneTick would have done.
 //----------------------------------------------------------------------
 
 void
 Machine::Run()
 {
     Instruction *instr = new Instruction;  // storage for decoded instruction
+    int budget = 0;		// instructions left before an interrupt
+				// can be due, if batchTicks
+    int exceptions;
 
     if(DebugIsEnabled('m'))
         printf("Starting thread \"%s\" at time %d\n",
 	       currentThread->getName(), stats->totalTicks);
+    if (hostStartTime == 0)
+	hostStartTime = HostTime();
     interrupt->setStatus(UserMode);
+    if (useThreadedCode && !singleStep && !DebugIsEnabled('m'))
+	RunThreaded();		// never returns
     for (;;) {
+	exceptions = exceptionCount;
         OneInstruction(instr);
-	interrupt->OneTick();
+	if (budget > 0 && exceptions == exceptionCount) {
+	    // nothing can be due yet, just advance the clock
+	    stats->totalTicks += UserTick;
+	    stats->userTicks += UserTick;
+	    budget--;
+	} else {
+	    interrupt->OneTick();
+	    if (batchTicks && !singleStep)
+		budget = interrupt->UserTicksBeforeDue();
+	}
 	if (singleStep && (runUntilTime <= stats->totalTicks))
 	  Debugger();
     }
@@ -93,16 +112,13 @@ TypeToReg(RegType reg, Instruction *instr)
 void
 Machine::OneInstruction(Instruction *instr)
 {
-    int raw;
     int nextLoadReg = 0; 	
     int nextLoadValue = 0; 	// record delayed load operation, to apply
 				// in the future
 
     // Fetch instruction 
-    if (!machine->ReadMem(registers[PCReg], 4, &raw))
+    if (!FetchInstruction(registers[PCReg], instr))
 	return;			// exception occurred
-    instr->value = raw;
-    instr->Decode();
 
     if (DebugIsEnabled('m')) {
        struct OpString *str = &opStrings[instr->opCode];
@@ -564,6 +580,42 @@ Machine::OneInstruction(Instruction *instr)
     registers[NextPCReg] = pcAfter;
 }
 
+//----------------------------------------------------------------------
+// Machine::FetchInstruction
+// 	Translate the program counter and return the decoded instruction
+//	stored there.  Decoding is done once per word of physical memory:
+//	the result stays in "decodeCache" until WriteMem stores into that
+//	word, or the whole frame is reloaded (see InvalidateDecodedPage).
+//
+//	Returns FALSE if the translation failed; the exception has
+//	already been raised, exactly as ReadMem would have done.
+//
+//	"addr" -- the virtual address of the instruction
+//	"instr" -- where to put the decoded instruction
+//----------------------------------------------------------------------
+
+bool
+Machine::FetchInstruction(int addr, Instruction *instr)
+{
+    int physAddr, slot;
+    ExceptionType exception;
+
+    exception = Translate(addr, &physAddr, 4, FALSE);
+    if (exception != NoException) {
+	RaiseException(exception, addr);
+	return FALSE;
+    }
+    slot = physAddr / 4;
+    if (!decodeValid[slot]) {
+	decodeCache[slot].value =
+		WordToHost(*(unsigned int *)&mainMemory[physAddr]);
+	decodeCache[slot].Decode();
+	decodeValid[slot] = TRUE;
+    }
+    *instr = decodeCache[slot];
+    return TRUE;
+}
+
 //----------------------------------------------------------------------
 // Machine::DelayedLoad
 // 	Simulate effects of a delayed load.
@@ -632,7 +684,7 @@ Instruction::Decode()
 // 	double-length result of the multiplication.
 //----------------------------------------------------------------------
 
-static void
+void
 Mult(int a, int b, bool signedArith, int* hiPtr, int* loPtr)
 {
     if ((a == 0) || (b == 0)) {
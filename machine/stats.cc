@@ -22,6 +22,10 @@ Statistics::Statistics()
     numDiskReads = numDiskWrites = 0;
     numConsoleCharsRead = numConsoleCharsWritten = 0;
     numPageFaults = numPacketsSent = numPacketsRecvd = 0;
+    numPageCopies = 0;
+    numPageOutWakeups = numPageOutFrees = numFaultPageOuts = 0;
+    numLocalPageOuts = numSuspends = numResumes = 0;
+    numZeroPageOuts = numPackedPageOuts = 0;
 }
 
 //----------------------------------------------------------------------
@@ -37,7 +41,13 @@ Statistics::Print()
 	idleTicks, systemTicks, userTicks);
     printf("Disk I/O: reads %d, writes %d\n", numDiskReads, numDiskWrites);
     printf("Console I/O: reads %d, writes %d\n", numConsoleCharsRead, numConsoleCharsWritten);
-    printf("Paging: faults %d\n", numPageFaults);
+    printf("Paging: faults %d, copied on write %d\n", numPageFaults, numPageCopies);
+    printf("Page-out: daemon woken %d, paged out %d; replaced at fault %d\n",
+	numPageOutWakeups, numPageOutFrees, numFaultPageOuts);
+    printf("Load control: replaced within resident set %d, suspended %d, resumed %d\n",
+	numLocalPageOuts, numSuspends, numResumes);
+    printf("Swap pool: zero pages %d, compressed pages %d\n", numZeroPageOuts,
+	numPackedPageOuts);
     printf("Network I/O: packets received %d, sent %d\n", numPacketsRecvd, 
 	numPacketsSent);
 }
@@ -33,6 +33,22 @@ class Statistics {
     int numConsoleCharsRead;	// number of characters read from the keyboard
     int numConsoleCharsWritten; // number of characters written to the display
     int numPageFaults;		// number of virtual memory page faults
+    int numPageCopies;		// number of pages shared by Fork that had
+				// to be copied, on the first write
+    int numPageOutWakeups;	// number of times the page-out daemon
+				// was woken up
+    int numPageOutFrees;	// number of pages it paged out
+    int numFaultPageOuts;	// number of pages replaced by a faulting
+				// thread, because none was free
+    int numLocalPageOuts;	// number of pages replaced by their own
+				// address space, at its resident set limit
+    int numSuspends;		// number of times an address space was
+				// swapped out by the medium-term scheduler
+    int numResumes;		// number of times one was let back in
+    int numZeroPageOuts;	// number of pages of zeros paged out,
+				// with no I/O, to the compressed pool
+    int numPackedPageOuts;	// number of other pages kept compressed
+				// in the pool, instead of going to disk
     int numPacketsSent;		// number of packets sent over the network
     int numPacketsRecvd;	// number of packets received over the network
 
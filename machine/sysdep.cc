@@ -33,6 +33,7 @@ extern "C" {
 #include <sys/time.h>
 #include <sys/socket.h>
 #include <sys/file.h>
+#include <sys/stat.h>
 #include <sys/un.h>
 #include <sys/mman.h>
 #ifdef HOST_i386
@@ -241,6 +242,21 @@ Tell(int fd)
 #endif
 }
 
+//----------------------------------------------------------------------
+// FileNumber
+// 	Return a number that identifies the file open as "fd" among all
+//	the files on its file system (its inode number).  Abort on error.
+//----------------------------------------------------------------------
+
+int 
+FileNumber(int fd)
+{
+    struct stat info;
+    int retVal = fstat(fd, &info);
+    ASSERT(retVal == 0);
+    return (int)info.st_ino;
+}
+
 
 //----------------------------------------------------------------------
 // Close
@@ -416,6 +432,21 @@ Delay(int seconds)
     (void) sleep((unsigned) seconds);
 }
 
+//----------------------------------------------------------------------
+// HostTime
+// 	Return the host wall-clock time, in seconds.  Only used to
+//	measure how fast the simulation itself runs.
+//----------------------------------------------------------------------
+
+double 
+HostTime()
+{
+    struct timeval now;
+
+    gettimeofday(&now, NULL);
+    return now.tv_sec + now.tv_usec / 1e6;
+}
+
 //----------------------------------------------------------------------
 // Abort
 // 	Quit and drop core.
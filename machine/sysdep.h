@@ -26,6 +26,7 @@ extern int ReadPartial(int fd, char *buffer, int nBytes);
 extern void WriteFile(int fd, char *buffer, int nBytes);
 extern void Lseek(int fd, int offset, int whence);
 extern int Tell(int fd);
+extern int FileNumber(int fd);
 extern void Close(int fd);
 extern bool Unlink(char *name);
 
@@ -43,6 +44,9 @@ extern void Abort();
 extern void Exit(int exitCode);
 extern void Delay(int seconds);
 
+// Host wall-clock time in seconds, for measuring the simulator itself
+extern double HostTime();
+
 // Initialize system so that cleanUp routine is called when user hits ctl-C
 extern void CallOnUserAbort(VoidNoArgFunctionPtr cleanUp);
 
@@ -0,0 +1,600 @@
+// threaded.cc -- threaded-code engine for the MIPS simulator
+//
+//   An alternative to Machine::OneInstruction.  Instead of fetching,
+//   decoding and switching on every instruction, each basic block is
+//   translated once into "threaded code": one ThreadedOp per instruction
+//   word, holding the address of the code that executes it (GCC's
+//   computed goto) and the operands already extracted.  A block is then
+//   run by jumping from handler to handler without going back through
+//   the generic fetch/decode/switch path.
+//
+//   Threaded code lives in "threadedCode", indexed like mainMemory, so
+//   it is thrown away by the same events that invalidate the decoded
+//   instruction cache: a store to the word, or a new page in the frame.
+//
+//   The register and memory effects of every instruction are exactly
+//   those of OneInstruction (including its delayed loads and branch
+//   delay slots).  Only the PC of the first instruction of a block is
+//   translated, so TLB statistics differ from the switch engine.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+
+#include "machine.h"
+#include "mipssim.h"
+#include "system.h"
+
+//----------------------------------------------------------------------
+// EndsBlock
+// 	Does the instruction transfer control?  Such an instruction
+//	ends a basic block, once its delay slot has been included.
+//----------------------------------------------------------------------
+
+static bool
+EndsBlock(int opCode)
+{
+    switch (opCode) {
+      case OP_BEQ: case OP_BGEZ: case OP_BGEZAL: case OP_BGTZ:
+      case OP_BLEZ: case OP_BLTZ: case OP_BLTZAL: case OP_BNE:
+      case OP_J: case OP_JAL: case OP_JALR: case OP_JR:
+	return TRUE;
+      default:
+	return FALSE;
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::TranslateBlock
+// 	Translate the basic block starting at physical address "physAddr"
+//	into threaded code.  We stop after the delay slot of the first
+//	control transfer, after a syscall, at the end of the page, or when
+//	we run into code that has already been translated.
+//
+//	"handlers" is the table of handler addresses in RunThreaded,
+//		indexed by opCode.
+//----------------------------------------------------------------------
+
+void
+Machine::TranslateBlock(int physAddr, void **handlers)
+{
+    int pageEnd = (physAddr / PageSize + 1) * PageSize;
+    bool delaySlot = FALSE;
+    Instruction *instr;
+    ThreadedOp *op;
+
+    DEBUG('m', "Translating block at physical address 0x%x\n", physAddr);
+    for (; physAddr < pageEnd; physAddr += 4) {
+	op = &threadedCode[ThreadedSlot(physAddr)];
+	if (op->handler != NULL)
+	    break;
+	instr = &decodeCache[physAddr / 4];
+	if (!decodeValid[physAddr / 4]) {
+	    instr->value = WordToHost(*(unsigned int *)&mainMemory[physAddr]);
+	    instr->Decode();
+	    decodeValid[physAddr / 4] = TRUE;
+	}
+	ASSERT(instr->opCode <= MaxOpcode);
+	op->rs = instr->rs;
+	op->rt = instr->rt;
+	op->rd = instr->rd;
+	op->extra = instr->extra;
+	op->handler = handlers[(int) instr->opCode];
+	if (delaySlot || instr->opCode == OP_SYSCALL)
+	    break;
+	delaySlot = EndsBlock(instr->opCode);
+    }
+}
+
+//----------------------------------------------------------------------
+// Machine::RunThreaded
+// 	Simulate the execution of a user-level program with the
+//	threaded-code engine.  Called by Machine::Run; never returns.
+//
+//	Control goes back to the block lookup at the top of the loop
+//	whenever the next instruction is not the next word of the block:
+//	a taken branch, an exception, the end of a page, or a page of
+//	physical memory getting new contents while another thread ran.
+//----------------------------------------------------------------------
+
+void
+Machine::RunThreaded()
+{
+    static void *handlers[MaxOpcode + 1] = {
+	&&do_BAD, &&do_ADD, &&do_ADDI, &&do_ADDIU,
+	&&do_ADDU, &&do_AND, &&do_ANDI, &&do_BEQ,
+	&&do_BGEZ, &&do_BGEZAL, &&do_BGTZ, &&do_BLEZ,
+	&&do_BLTZ, &&do_BLTZAL, &&do_BNE, &&do_BAD,
+	&&do_DIV, &&do_DIVU, &&do_J, &&do_JAL,
+	&&do_JALR, &&do_JR, &&do_LB, &&do_LBU,
+	&&do_LH, &&do_LHU, &&do_LUI, &&do_LW,
+	&&do_LWL, &&do_LWR, &&do_BAD, &&do_MFHI,
+	&&do_MFLO, &&do_BAD, &&do_MTHI, &&do_MTLO,
+	&&do_MULT, &&do_MULTU, &&do_NOR, &&do_OR,
+	&&do_ORI, &&do_BAD, &&do_SB, &&do_SH,
+	&&do_SLL, &&do_SLLV, &&do_SLT, &&do_SLTI,
+	&&do_SLTIU, &&do_SLTU, &&do_SRA, &&do_SRAV,
+	&&do_SRL, &&do_SRLV, &&do_SUB, &&do_SUBU,
+	&&do_SW, &&do_SWL, &&do_SWR, &&do_XOR,
+	&&do_XORI, &&do_SYSCALL, &&do_ILLEGAL, &&do_ILLEGAL
+    };
+    ThreadedOp *op;
+    ExceptionType exception;
+    int pc, physAddr, epoch;
+    int pcAfter, nextLoadReg, nextLoadValue;
+    int sum, diff, tmp, value;
+    unsigned int rs, rt, imm;
+    int budget = 0;		// see Machine::Run
+
+    for (;;) {
+	// Find the threaded code for the block at PC.  This is the only
+	// place where the PC gets translated.
+	pc = registers[PCReg];
+	exception = Translate(pc, &physAddr, 4, FALSE);
+	if (exception != NoException) {
+	    RaiseException(exception, pc);
+	    goto trapped;
+	}
+	op = &threadedCode[ThreadedSlot(physAddr)];
+	if (op->handler == NULL)
+	    TranslateBlock(physAddr, handlers);
+	epoch = translationEpoch;
+
+      dispatch:
+	pcAfter = registers[NextPCReg] + 4;
+	nextLoadReg = 0;
+	nextLoadValue = 0;
+	goto *op->handler;
+
+      do_ADD:
+	sum = registers[op->rs] + registers[op->rt];
+	if (!((registers[op->rs] ^ registers[op->rt]) & SIGN_BIT) &&
+	    ((registers[op->rs] ^ sum) & SIGN_BIT)) {
+	    RaiseException(OverflowException, 0);
+	    goto trapped;
+	}
+	registers[op->rd] = sum;
+	goto retire;
+
+      do_ADDI:
+	sum = registers[op->rs] + op->extra;
+	if (!((registers[op->rs] ^ op->extra) & SIGN_BIT) &&
+	    ((op->extra ^ sum) & SIGN_BIT)) {
+	    RaiseException(OverflowException, 0);
+	    goto trapped;
+	}
+	registers[op->rt] = sum;
+	goto retire;
+
+      do_ADDIU:
+	registers[op->rt] = registers[op->rs] + op->extra;
+	goto retire;
+
+      do_ADDU:
+	registers[op->rd] = registers[op->rs] + registers[op->rt];
+	goto retire;
+
+      do_AND:
+	registers[op->rd] = registers[op->rs] & registers[op->rt];
+	goto retire;
+
+      do_ANDI:
+	registers[op->rt] = registers[op->rs] & (op->extra & 0xffff);
+	goto retire;
+
+      do_BEQ:
+	if (registers[op->rs] == registers[op->rt])
+	    pcAfter = registers[NextPCReg] + IndexToAddr(op->extra);
+	goto retire;
+
+      do_BGEZAL:
+	registers[R31] = registers[NextPCReg] + 4;
+      do_BGEZ:
+	if (!(registers[op->rs] & SIGN_BIT))
+	    pcAfter = registers[NextPCReg] + IndexToAddr(op->extra);
+	goto retire;
+
+      do_BGTZ:
+	if (registers[op->rs] > 0)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(op->extra);
+	goto retire;
+
+      do_BLEZ:
+	if (registers[op->rs] <= 0)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(op->extra);
+	goto retire;
+
+      do_BLTZAL:
+	registers[R31] = registers[NextPCReg] + 4;
+      do_BLTZ:
+	if (registers[op->rs] & SIGN_BIT)
+	    pcAfter = registers[NextPCReg] + IndexToAddr(op->extra);
+	goto retire;
+
+      do_BNE:
+	if (registers[op->rs] != registers[op->rt])
+	    pcAfter = registers[NextPCReg] + IndexToAddr(op->extra);
+	goto retire;
+
+      do_DIV:
+	if (registers[op->rt] == 0) {
+	    registers[LoReg] = 0;
+	    registers[HiReg] = 0;
+	} else {
+	    registers[LoReg] =  registers[op->rs] / registers[op->rt];
+	    registers[HiReg] = registers[op->rs] % registers[op->rt];
+	}
+	goto retire;
+
+      do_DIVU:
+	rs = (unsigned int) registers[op->rs];
+	rt = (unsigned int) registers[op->rt];
+	if (rt == 0) {
+	    registers[LoReg] = 0;
+	    registers[HiReg] = 0;
+	} else {
+	    tmp = rs / rt;
+	    registers[LoReg] = (int) tmp;
+	    tmp = rs % rt;
+	    registers[HiReg] = (int) tmp;
+	}
+	goto retire;
+
+      do_JAL:
+	registers[R31] = registers[NextPCReg] + 4;
+      do_J:
+	pcAfter = (pcAfter & 0xf0000000) | IndexToAddr(op->extra);
+	goto retire;
+
+      do_JALR:
+	registers[op->rd] = registers[NextPCReg] + 4;
+      do_JR:
+	pcAfter = registers[op->rs];
+	goto retire;
+
+      do_LB:
+	tmp = registers[op->rs] + op->extra;
+	if (!ReadMem(tmp, 1, &value))
+	    goto trapped;
+	if (value & 0x80)
+	    value |= 0xffffff00;
+	else
+	    value &= 0xff;
+	nextLoadReg = op->rt;
+	nextLoadValue = value;
+	goto retire;
+
+      do_LBU:
+	tmp = registers[op->rs] + op->extra;
+	if (!ReadMem(tmp, 1, &value))
+	    goto trapped;
+	nextLoadReg = op->rt;
+	nextLoadValue = value & 0xff;
+	goto retire;
+
+      do_LH:
+	tmp = registers[op->rs] + op->extra;
+	if (tmp & 0x1) {
+	    RaiseException(AddressErrorException, tmp);
+	    goto trapped;
+	}
+	if (!ReadMem(tmp, 2, &value))
+	    goto trapped;
+	if (value & 0x8000)
+	    value |= 0xffff0000;
+	else
+	    value &= 0xffff;
+	nextLoadReg = op->rt;
+	nextLoadValue = value;
+	goto retire;
+
+      do_LHU:
+	tmp = registers[op->rs] + op->extra;
+	if (tmp & 0x1) {
+	    RaiseException(AddressErrorException, tmp);
+	    goto trapped;
+	}
+	if (!ReadMem(tmp, 2, &value))
+	    goto trapped;
+	nextLoadReg = op->rt;
+	nextLoadValue = value & 0xffff;
+	goto retire;
+
+      do_LUI:
+	registers[op->rt] = op->extra << 16;
+	goto retire;
+
+      do_LW:
+	tmp = registers[op->rs] + op->extra;
+	if (tmp & 0x3) {
+	    RaiseException(AddressErrorException, tmp);
+	    goto trapped;
+	}
+	if (!ReadMem(tmp, 4, &value))
+	    goto trapped;
+	nextLoadReg = op->rt;
+	nextLoadValue = value;
+	goto retire;
+
+      do_LWL:
+	tmp = registers[op->rs] + op->extra;
+	ASSERT((tmp & 0x3) == 0);		// see OneInstruction
+	if (!ReadMem(tmp, 4, &value))
+	    goto trapped;
+	if (registers[LoadReg] == op->rt)
+	    nextLoadValue = registers[LoadValueReg];
+	else
+	    nextLoadValue = registers[op->rt];
+	switch (tmp & 0x3) {
+	  case 0:
+	    nextLoadValue = value;
+	    break;
+	  case 1:
+	    nextLoadValue = (nextLoadValue & 0xff) | (value << 8);
+	    break;
+	  case 2:
+	    nextLoadValue = (nextLoadValue & 0xffff) | (value << 16);
+	    break;
+	  case 3:
+	    nextLoadValue = (nextLoadValue & 0xffffff) | (value << 24);
+	    break;
+	}
+	nextLoadReg = op->rt;
+	goto retire;
+
+      do_LWR:
+	tmp = registers[op->rs] + op->extra;
+	ASSERT((tmp & 0x3) == 0);		// see OneInstruction
+	if (!ReadMem(tmp, 4, &value))
+	    goto trapped;
+	if (registers[LoadReg] == op->rt)
+	    nextLoadValue = registers[LoadValueReg];
+	else
+	    nextLoadValue = registers[op->rt];
+	switch (tmp & 0x3) {
+	  case 0:
+	    nextLoadValue = (nextLoadValue & 0xffffff00) |
+		((value >> 24) & 0xff);
+	    break;
+	  case 1:
+	    nextLoadValue = (nextLoadValue & 0xffff0000) |
+		((value >> 16) & 0xffff);
+	    break;
+	  case 2:
+	    nextLoadValue = (nextLoadValue & 0xff000000)
+		| ((value >> 8) & 0xffffff);
+	    break;
+	  case 3:
+	    nextLoadValue = value;
+	    break;
+	}
+	nextLoadReg = op->rt;
+	goto retire;
+
+      do_MFHI:
+	registers[op->rd] = registers[HiReg];
+	goto retire;
+
+      do_MFLO:
+	registers[op->rd] = registers[LoReg];
+	goto retire;
+
+      do_MTHI:
+	registers[HiReg] = registers[op->rs];
+	goto retire;
+
+      do_MTLO:
+	registers[LoReg] = registers[op->rs];
+	goto retire;
+
+      do_MULT:
+	Mult(registers[op->rs], registers[op->rt], TRUE,
+	     &registers[HiReg], &registers[LoReg]);
+	goto retire;
+
+      do_MULTU:
+	Mult(registers[op->rs], registers[op->rt], FALSE,
+	     &registers[HiReg], &registers[LoReg]);
+	goto retire;
+
+      do_NOR:
+	registers[op->rd] = ~(registers[op->rs] | registers[op->rt]);
+	goto retire;
+
+      do_OR:
+	registers[op->rd] = registers[op->rs] | registers[op->rs];
+	goto retire;
+
+      do_ORI:
+	registers[op->rt] = registers[op->rs] | (op->extra & 0xffff);
+	goto retire;
+
+      do_SB:
+	if (!WriteMem((unsigned) (registers[op->rs] + op->extra), 1,
+		      registers[op->rt]))
+	    goto trapped;
+	goto retire;
+
+      do_SH:
+	if (!WriteMem((unsigned) (registers[op->rs] + op->extra), 2,
+		      registers[op->rt]))
+	    goto trapped;
+	goto retire;
+
+      do_SLL:
+	registers[op->rd] = registers[op->rt] << op->extra;
+	goto retire;
+
+      do_SLLV:
+	registers[op->rd] = registers[op->rt] << (registers[op->rs] & 0x1f);
+	goto retire;
+
+      do_SLT:
+	registers[op->rd] = (registers[op->rs] < registers[op->rt]) ? 1 : 0;
+	goto retire;
+
+      do_SLTI:
+	registers[op->rt] = (registers[op->rs] < op->extra) ? 1 : 0;
+	goto retire;
+
+      do_SLTIU:
+	rs = registers[op->rs];
+	imm = op->extra;
+	registers[op->rt] = (rs < imm) ? 1 : 0;
+	goto retire;
+
+      do_SLTU:
+	rs = registers[op->rs];
+	rt = registers[op->rt];
+	registers[op->rd] = (rs < rt) ? 1 : 0;
+	goto retire;
+
+      do_SRA:
+	registers[op->rd] = registers[op->rt] >> op->extra;
+	goto retire;
+
+      do_SRAV:
+	registers[op->rd] = registers[op->rt] >> (registers[op->rs] & 0x1f);
+	goto retire;
+
+      do_SRL:
+	tmp = registers[op->rt];
+	tmp >>= op->extra;
+	registers[op->rd] = tmp;
+	goto retire;
+
+      do_SRLV:
+	tmp = registers[op->rt];
+	tmp >>= (registers[op->rs] & 0x1f);
+	registers[op->rd] = tmp;
+	goto retire;
+
+      do_SUB:
+	diff = registers[op->rs] - registers[op->rt];
+	if (((registers[op->rs] ^ registers[op->rt]) & SIGN_BIT) &&
+	    ((registers[op->rs] ^ diff) & SIGN_BIT)) {
+	    RaiseException(OverflowException, 0);
+	    goto trapped;
+	}
+	registers[op->rd] = diff;
+	goto retire;
+
+      do_SUBU:
+	registers[op->rd] = registers[op->rs] - registers[op->rt];
+	goto retire;
+
+      do_SW:
+	if (!WriteMem((unsigned) (registers[op->rs] + op->extra), 4,
+		      registers[op->rt]))
+	    goto trapped;
+	goto retire;
+
+      do_SWL:
+	tmp = registers[op->rs] + op->extra;
+	ASSERT((tmp & 0x3) == 0);		// see OneInstruction
+	if (!ReadMem((tmp & ~0x3), 4, &value))
+	    goto trapped;
+	switch (tmp & 0x3) {
+	  case 0:
+	    value = registers[op->rt];
+	    break;
+	  case 1:
+	    value = (value & 0xff000000) | ((registers[op->rt] >> 8) &
+					    0xffffff);
+	    break;
+	  case 2:
+	    value = (value & 0xffff0000) | ((registers[op->rt] >> 16) &
+					    0xffff);
+	    break;
+	  case 3:
+	    value = (value & 0xffffff00) | ((registers[op->rt] >> 24) &
+					    0xff);
+	    break;
+	}
+	if (!WriteMem((tmp & ~0x3), 4, value))
+	    goto trapped;
+	goto retire;
+
+      do_SWR:
+	tmp = registers[op->rs] + op->extra;
+	ASSERT((tmp & 0x3) == 0);		// see OneInstruction
+	if (!ReadMem((tmp & ~0x3), 4, &value))
+	    goto trapped;
+	switch (tmp & 0x3) {
+	  case 0:
+	    value = (value & 0xffffff) | (registers[op->rt] << 24);
+	    break;
+	  case 1:
+	    value = (value & 0xffff) | (registers[op->rt] << 16);
+	    break;
+	  case 2:
+	    value = (value & 0xff) | (registers[op->rt] << 8);
+	    break;
+	  case 3:
+	    value = registers[op->rt];
+	    break;
+	}
+	if (!WriteMem((tmp & ~0x3), 4, value))
+	    goto trapped;
+	goto retire;
+
+      do_SYSCALL:
+	RaiseException(SyscallException, 0);
+	goto trapped;
+
+      do_XOR:
+	registers[op->rd] = registers[op->rs] ^ registers[op->rt];
+	goto retire;
+
+      do_XORI:
+	registers[op->rt] = registers[op->rs] ^ (op->extra & 0xffff);
+	goto retire;
+
+      do_ILLEGAL:
+	RaiseException(IllegalInstrException, 0);
+	goto trapped;
+
+      do_BAD:
+	ASSERT(FALSE);
+
+      retire:
+	// The instruction completed: do the delayed load and advance the
+	// program counters, as at the end of OneInstruction.
+	registers[registers[LoadReg]] = registers[LoadValueReg];
+	registers[LoadReg] = nextLoadReg;
+	registers[LoadValueReg] = nextLoadValue;
+	registers[0] = 0;
+	registers[PrevPCReg] = registers[PCReg];
+	registers[PCReg] = registers[NextPCReg];
+	registers[NextPCReg] = pcAfter;
+	if (budget > 0) {
+	    stats->totalTicks += UserTick;
+	    stats->userTicks += UserTick;
+	    budget--;
+	} else {
+	    interrupt->OneTick();
+	    if (batchTicks)
+		budget = interrupt->UserTicksBeforeDue();
+	}
+
+	// Stay in the block while execution falls through to the next
+	// word and nothing was paged in or out behind our back.
+	if (registers[PCReg] == pc + 4 && epoch == translationEpoch) {
+	    pc += 4;
+	    op++;
+	    if (op->handler != NULL)
+		goto dispatch;
+	}
+	continue;
+
+      trapped:
+	// An exception was raised; the kernel may have changed the
+	// PC, the page tables or memory, so find the block again.
+	// It may also have scheduled an interrupt, so do a full tick.
+	interrupt->OneTick();
+	if (batchTicks)
+	    budget = interrupt->UserTicksBeforeDue();
+    }
+}
@@ -172,10 +172,124 @@ bool Machine::WriteMem(int addr, int size, int value)
             default:
                 ASSERT(FALSE);
         }
+    decodeValid[physicalAddress / 4] = FALSE;  // the word may have been code
+    threadedCode[ThreadedSlot(physicalAddress)].handler = NULL;
 
     return TRUE;
 }
 
+//----------------------------------------------------------------------
+// Machine::TranslateForCopy
+// 	Translate "virtAddr", of the running address space, for the kernel
+//	to copy to or from it, as for a load or store of a byte by the
+//	program: the page is brought into memory (and the TLB) if needed,
+//	and gets its own copy if it is shared copy-on-write.  Returns the
+//	physical address, or -1 if the page is really read-only.  A
+//	program passing an address outside its address space is killed
+//	(see ExceptionHandler).
+//
+//	The physical address is good until the thread next waits.
+//----------------------------------------------------------------------
+
+int Machine::TranslateForCopy(int virtAddr, bool writing)
+{
+    int physAddr;
+    bool readOnly = FALSE;
+
+    for (;;)
+        {
+            ExceptionType exception = Translate(virtAddr, &physAddr, 1, writing);
+            if (exception == NoException)
+                return physAddr;
+            if (exception == ReadOnlyException && readOnly)
+                return -1;  // it was not copy-on-write
+            readOnly = (exception == ReadOnlyException);
+            registers[BadVAddrReg] = virtAddr;
+            ExceptionHandler(exception);
+        }
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyIn
+// 	Copy "size" bytes of the running address space, from "virtAddr",
+//	into kernel buffer "into", a page at a time.  Returns FALSE if a
+//	page could not be read.
+//----------------------------------------------------------------------
+
+bool Machine::CopyIn(int virtAddr, char *into, int size)
+{
+    while (size > 0)
+        {
+            int count = min(size, PageSize - (int)((unsigned)virtAddr % PageSize));
+            int physAddr = TranslateForCopy(virtAddr, FALSE);
+            if (physAddr == -1)
+                return FALSE;
+            memcpy(into, &mainMemory[physAddr], count);
+            virtAddr += count;
+            into += count;
+            size -= count;
+        }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyOut
+// 	Copy "size" bytes of kernel buffer "from" to the running address
+//	space, at "virtAddr", a page at a time.  Returns FALSE if a page
+//	could not be written: it is read-only.
+//----------------------------------------------------------------------
+
+bool Machine::CopyOut(char *from, int virtAddr, int size)
+{
+    while (size > 0)
+        {
+            int count = min(size, PageSize - (int)((unsigned)virtAddr % PageSize));
+            int physAddr = TranslateForCopy(virtAddr, TRUE);
+            if (physAddr == -1)
+                return FALSE;
+            memcpy(&mainMemory[physAddr], from, count);
+            for (int word = physAddr / 4; word <= (physAddr + count - 1) / 4; word++)
+                {  // the words may have been code, like in WriteMem
+                    decodeValid[word] = FALSE;
+                    threadedCode[ThreadedSlot(word * 4)].handler = NULL;
+                }
+            virtAddr += count;
+            from += count;
+            size -= count;
+        }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// Machine::CopyInString
+// 	Copy the null-terminated string of the running address space at
+//	"virtAddr" into kernel buffer "into", which can hold "maxSize"
+//	bytes, a page at a time.  Returns the length of the string, or -1
+//	if it does not fit, or a page could not be read.
+//----------------------------------------------------------------------
+
+int Machine::CopyInString(int virtAddr, char *into, int maxSize)
+{
+    int length = 0;
+
+    while (length < maxSize)
+        {
+            int count = min(maxSize - length, PageSize - (int)((unsigned)virtAddr % PageSize));
+            int physAddr = TranslateForCopy(virtAddr, FALSE);
+            if (physAddr == -1)
+                return -1;
+            char *end = (char *)memchr(&mainMemory[physAddr], '\0', count);
+            if (end != NULL)
+                count = end - &mainMemory[physAddr] + 1;
+            memcpy(into + length, &mainMemory[physAddr], count);
+            length += count;
+            if (end != NULL)
+                return length - 1;
+            virtAddr += count;
+        }
+    return -1;
+}
+
 //----------------------------------------------------------------------
 // Machine::Translate
 // 	Translate a virtual address into a physical address, using
@@ -189,6 +303,10 @@ bool Machine::WriteMem(int addr, int size, int value)
 //	"physAddr" -- the place to store the physical address
 //	"size" -- the amount of memory being read or written
 // 	"writing" -- if TRUE, check the "read-only" bit in the TLB
+//
+//	Successful translations are remembered in a small direct-mapped
+//	cache, indexed by virtual page; a hit only updates the statistics
+//	and the use/dirty bits, exactly as the full lookup would.
 //----------------------------------------------------------------------
 
 ExceptionType Machine::Translate(int virtAddr, int *physAddr, int size, bool writing)
@@ -197,9 +315,31 @@ ExceptionType Machine::Translate(int virtAddr, int *physAddr, int size, bool wri
     unsigned int vpn, offset;
     TranslationEntry *entry;
     unsigned int pageFrame;
+    TranslationCacheEntry *cached;
 
-    machine->timeStamp++;  // update timestamp
-
+    // first, look in the translation cache; a hit has the same effect as
+    // the lookup below, without the checks that can't fail
+    vpn = (unsigned)virtAddr / PageSize;
+    offset = (unsigned)virtAddr % PageSize;
+    cached = &translationCache[vpn % TranslationCacheSize];
+    if (cached->virtualPage == (int)vpn && (virtAddr & (size - 1)) == 0 &&
+        (cached->writable || !writing))
+        {
+            entry = cached->entry;
+            if (tlb != NULL)
+                {
+                    TLBHitCount++;
+                    if (TLBReplaceStrategy == TLB_LRU)
+                        entry->tValue = ++timeStamp;
+                }
+            entry->use = TRUE;
+            if (writing)
+                entry->dirty = TRUE;
+            *physAddr = cached->frameAddr + offset;
+            if (traceFile != -1)
+                TraceReference(vpn, writing);
+            return NoException;
+        }
 
     DEBUG('a', "\tTranslate 0x%x, %s: ", virtAddr, writing ? "write" : "read");
 
@@ -210,44 +350,27 @@ ExceptionType Machine::Translate(int virtAddr, int *physAddr, int size, bool wri
             return AddressErrorException;
         }
 
-    // calculate the virtual page number, and offset within the page,
-    // from the virtual address
-    vpn = (unsigned)virtAddr / PageSize;
-    offset = (unsigned)virtAddr % PageSize;
-
     if (tlb == NULL)
-        {  // => page table => vpn is index into table
+        {  // => page table => look (currentSpaceId, vpn) up in the inverted page table
+            int frame;
             if (vpn >= pageTableSize)
                 {
                     DEBUG('a', "virtual page # %d too large for page table size %d!\n", virtAddr,
                           pageTableSize);
                     return AddressErrorException;
                 }
-            else if (!pageTable[vpn].valid)
+            else if ((frame = pageTable->Lookup(currentSpaceId, vpn)) == -1)
                 {
-                    DEBUG('a', "virtual page # %d too large for page table size %d!\n", virtAddr,
-                          pageTableSize);
+                    DEBUG('a', "virtual page # %d not in memory!\n", vpn);
                     return PageFaultException;
                 }
-            switch (machine->PTReplaceStrategy)
-                {
-                    case PT_LRU:
-                        {
-                            pageTable[vpn].tValue = machine->timeStamp;  // update last used time
-                        }
-                        break;
-                        // case PT_LFU:
-                        //     {
-                        //         pageTable[vpn].tValue++;  // update used count
-                        //     }
-                        //     break;
-                }
-            entry = &pageTable[vpn];
+            entry = &pageTable->entries[pageTable->entries[frame].physicalPage];
         }
     else
         {
-            for (entry = NULL, i = 0; i < TLBSize; i++)
-                if (tlb[i].valid && (tlb[i].virtualPage == vpn))
+            int first = (vpn % TLBSets) * TLBSetSize;  // only vpn's set can hold it
+            for (entry = NULL, i = first; i < first + TLBSetSize; i++)
+                if (tlb[i].valid && (tlb[i].virtualPage == vpn) && tlb[i].asid == currentASID)
                     {
                         TLBHitCount++;
                         entry = &tlb[i];  // FOUND!
@@ -255,8 +378,7 @@ ExceptionType Machine::Translate(int virtAddr, int *physAddr, int size, bool wri
                             {
                                 case TLB_LRU:
                                     {
-                                        tlb[i].tValue =
-                                            machine->timeStamp;  // update last used time
+                                        tlb[i].tValue = ++timeStamp;  // update last used time
                                     }
                                     break;
                                     // case TLB_LFU:
@@ -271,10 +393,21 @@ ExceptionType Machine::Translate(int virtAddr, int *physAddr, int size, bool wri
             if (entry == NULL)
                 {  // not found
                     TLBMissCount++;
-                    DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
-                    return PageFaultException;  // really, this is a TLB fault,
-                                                // the page may be in memory,
-                                                // but not in the TLB
+                    int frame;
+                    if (hardwareWalker && vpn < pageTableSize &&
+                        (frame = pageTable->Lookup(currentSpaceId, vpn)) != -1)
+                        {  // the page is in memory: walk the page table ourselves
+                            i = RefillTLB(vpn, pageTable->entries[frame].physicalPage);
+                            entry = &tlb[i];
+                            DEBUG('a', "TLB refilled by the walker, ");
+                        }
+                    else
+                        {
+                            DEBUG('a', "*** no valid TLB entry found for this virtual page!\n");
+                            return PageFaultException;  // really, this is a TLB fault,
+                                                        // the page may be in memory,
+                                                        // but not in the TLB
+                        }
                 }
         }
 
@@ -287,7 +420,7 @@ ExceptionType Machine::Translate(int virtAddr, int *physAddr, int size, bool wri
 
     // if the pageFrame is too big, there is something really wrong!
     // An invalid translation was loaded into the page table or TLB.
-    if (pageFrame >= NumPhysPages)
+    if (pageFrame >= (unsigned) NumPhysPages)
         {
             DEBUG('a', "*** frame %d > %d!\n", pageFrame, NumPhysPages);
             return BusErrorException;
@@ -298,5 +431,200 @@ ExceptionType Machine::Translate(int virtAddr, int *physAddr, int size, bool wri
     *physAddr = pageFrame * PageSize + offset;
     ASSERT((*physAddr >= 0) && ((*physAddr + size) <= MemorySize));
     DEBUG('a', "phys addr = 0x%x\n", *physAddr);
+
+    if (!DebugIsEnabled('a'))  // hits would skip the debugging output
+        {
+            cached->virtualPage = vpn;
+            cached->entry = entry;
+            cached->frameAddr = pageFrame * PageSize;
+            cached->writable = !entry->readOnly;
+        }
+    if (traceFile != -1)
+        TraceReference(vpn, writing);
     return NoException;
 }
+
+//----------------------------------------------------------------------
+// Machine::FlushTranslationCache
+// 	Empty the translation cache of Translate.  Called whenever the
+//	TLB is cleared or another page table is installed.
+//----------------------------------------------------------------------
+
+void Machine::FlushTranslationCache()
+{
+    for (int i = 0; i < TranslationCacheSize; i++)
+        translationCache[i].virtualPage = -1;
+}
+
+//----------------------------------------------------------------------
+// Machine::InvalidateTranslation
+// 	Drop the cached translation of virtual page "vpn", if any.  Called
+//	before the TLB or page table entry for the page is replaced or
+//	invalidated.
+//----------------------------------------------------------------------
+
+void Machine::InvalidateTranslation(int vpn)
+{
+    TranslationCacheEntry *cached = &translationCache[(unsigned)vpn % TranslationCacheSize];
+
+    if (cached->virtualPage == vpn)
+        cached->virtualPage = -1;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::InvertedPageTable
+// 	Initialize an inverted page table of "numEntries" entries, plus
+//	"aliasCount" alias entries for shared pages.  There are as many
+//	hash chains as entries, so chains stay short.
+//----------------------------------------------------------------------
+
+InvertedPageTable::InvertedPageTable(int numEntries, int aliasCount)
+{
+    size = numEntries;
+    numAliases = aliasCount;
+    entries = new InvertedTranslationEntry[size + numAliases];
+    anchors = new int[size];
+    for (int i = 0; i < size + numAliases; i++)
+        {
+            entries[i].valid = FALSE;
+            entries[i].use = FALSE;
+            entries[i].dirty = FALSE;
+            entries[i].readOnly = FALSE;
+            entries[i].copyOnWrite = FALSE;
+            entries[i].physicalPage = i;
+            entries[i].next = (i >= size && i + 1 < size + numAliases) ? i + 1 : -1;
+        }
+    for (int i = 0; i < size; i++)
+        anchors[i] = -1;
+    freeAliases = (numAliases > 0) ? size : -1;
+}
+
+InvertedPageTable::~InvertedPageTable()
+{
+    delete[] entries;
+    delete[] anchors;
+}
+
+int InvertedPageTable::Hash(int tid, int vpn)
+{
+    return (unsigned)(tid * 131 + vpn) % size;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Lookup
+// 	Find the entry holding virtual page "vpn" of address space "tid",
+//	by walking its hash chain.  Returns -1 if the page isn't there.
+//----------------------------------------------------------------------
+
+int InvertedPageTable::Lookup(int tid, int vpn)
+{
+    for (int i = anchors[Hash(tid, vpn)]; i != -1; i = entries[i].next)
+        if (entries[i].virtualPage == vpn && entries[i].tid == tid)
+            return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Map
+// 	Record that entry "index" (which must be free) holds virtual page
+//	"vpn" of address space "tid".  The caller sets the other bits.
+//----------------------------------------------------------------------
+
+void InvertedPageTable::Map(int index, int tid, int vpn)
+{
+    int bucket = Hash(tid, vpn);
+
+    ASSERT(!entries[index].valid);
+    entries[index].virtualPage = vpn;
+    entries[index].tid = tid;
+    entries[index].valid = TRUE;
+    entries[index].use = FALSE;
+    entries[index].next = anchors[bucket];
+    anchors[bucket] = index;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::MapAlias
+// 	Record that virtual page "vpn" of address space "tid" shares the
+//	page held by entry "index", using a free alias entry.  The bits
+//	of the page stay in entry "index".  Returns the alias entry, or -1
+//	if there is no free one.
+//----------------------------------------------------------------------
+
+int InvertedPageTable::MapAlias(int index, int tid, int vpn)
+{
+    int alias = freeAliases;
+
+    ASSERT(entries[index].valid);
+    if (alias == -1)
+        return -1;
+    freeAliases = entries[alias].next;
+    entries[alias] = entries[index];
+    entries[alias].valid = FALSE;
+    Map(alias, tid, vpn);
+    entries[alias].use = entries[index].use;
+    return alias;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::FindAlias
+// 	Return an alias entry sharing the page held by entry "index", or
+//	-1 if the page is not shared.  Searches all the alias entries, so
+//	callers only do this for pages they know are shared.
+//----------------------------------------------------------------------
+
+int InvertedPageTable::FindAlias(int index)
+{
+    int page = entries[index].physicalPage;
+
+    for (int i = size; i < size + numAliases; i++)
+        if (i != index && entries[i].valid && entries[i].physicalPage == page)
+            return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::ReplaceWithAlias
+// 	The address space of entry "index", which holds a shared page, is
+//	giving the page up.  Hand the entry, with its bits, over to the
+//	address space of one of the aliases sharing the page, and free
+//	that alias.  Returns the address space the entry now belongs to.
+//----------------------------------------------------------------------
+
+int InvertedPageTable::ReplaceWithAlias(int index)
+{
+    int alias = FindAlias(index);
+
+    ASSERT(index < size && alias != -1);
+    int tid = entries[alias].tid;
+    int vpn = entries[alias].virtualPage;
+    bool use = entries[index].use || entries[alias].use;
+    Unmap(alias);
+    Unmap(index);
+    Map(index, tid, vpn);
+    entries[index].use = use;
+    return tid;
+}
+
+//----------------------------------------------------------------------
+// InvertedPageTable::Unmap
+// 	Free entry "index", taking it off its hash chain.  A free alias
+//	entry goes back on the list of free ones.
+//----------------------------------------------------------------------
+
+void InvertedPageTable::Unmap(int index)
+{
+    int *link = &anchors[Hash(entries[index].tid, entries[index].virtualPage)];
+
+    ASSERT(entries[index].valid);
+    while (*link != index)
+        link = &entries[*link].next;
+    *link = entries[index].next;
+    entries[index].next = -1;
+    entries[index].valid = FALSE;
+    if (index >= size)
+        {
+            entries[index].next = freeAliases;
+            freeAliases = index;
+        }
+}
@@ -41,13 +41,109 @@ class TranslationEntry {
 			// page is referenced or modified.
     bool dirty;         // This bit is set by the hardware every time the
 			// page is modified.
+    int asid;		// In the TLB: the address space the translation
+			// belongs to; only entries tagged with
+			// Machine::currentASID are used.
 };
 
+// The following class defines an entry in the host-side translation
+// cache kept by Machine::Translate.  It remembers, for one virtual page of
+// the running address space, which page table or TLB entry translated it
+// last, so that the next reference to the page can skip the lookup.
+// It is not part of the simulated hardware: the kernel never sees it.
+
+class TranslationCacheEntry {
+  public:
+    int virtualPage;		// The page cached in this slot, -1 if none
+    TranslationEntry *entry;	// The entry that translated it
+    int frameAddr;		// entry->physicalPage * PageSize
+    bool writable;		// FALSE if the page is read-only
+};
+
+// The following class defines an entry in an inverted page table: a
+// translation entry that also says which address space the page belongs
+// to, since the table is shared by all of them.
+
+// Where else the contents of a resident page can be found, which says
+// what must happen to it when it is replaced (see Machine::PageOut).
+
+enum PageBacking { FileBacked,	// In the executable, unless the page is
+				// dirty: a clean page is just dropped
+		   ZeroFill,	// All zeros, unless the page is dirty:
+				// a clean page is just dropped
+		   MappedFile,	// In a file mapped by Mmap: a dirty page
+				// is written back to it, a clean one is
+				// just dropped
+		   Anonymous };	// Nowhere else: always written to swap
+
 class InvertedTranslationEntry:public TranslationEntry
 {
   public:
     int uid;
-    int tid;
+    int tid;		// The address space (AddrSpace::spaceId) the page
+			// belongs to.
+    PageBacking backing;	// Only meaningful for physical pages
+    bool prefetched;	// Brought in by fault-around, and not known
+			// to have been referenced since
+    bool copyOnWrite;	// Shared with other address spaces since a
+			// Fork: mapped read-only, and copied on the
+			// first write (see Machine::CopyOnWriteHandler)
+    int next;		// The next entry in the same hash chain, -1 if
+			// none.
+};
+
+// The following class defines a system-wide inverted page table: one
+// entry per physical page (or per page of swap space), saying which
+// virtual page of which address space it holds.  A hash table, keyed on
+// (tid, vpn), finds the entry holding a given virtual page without
+// searching the whole table.
+//
+// A page shared by several address spaces (after a copy-on-write Fork)
+// is held by its own entry, for one of them, and by "alias" entries,
+// one for each of the others.  Alias entries come after the "size"
+// others; their physicalPage says which page they share.  Lookup
+// finds aliases just like the other entries, so the page (or swap
+// page) of the entry it returns is always entries[i].physicalPage.
+// The bits of a shared page (dirty, read-only, ...) are those of the
+// entry that holds it, entries[entries[i].physicalPage].
+
+class InvertedPageTable {
+  public:
+    InvertedPageTable(int numEntries, int aliasCount);
+					// Create a table of "numEntries"
+					// entries, and "aliasCount" alias
+					// entries, all invalid
+    ~InvertedPageTable();
+
+    int Lookup(int tid, int vpn);	// Return the entry holding virtual
+					// page "vpn" of address space "tid",
+					// -1 if there is none
+    void Map(int index, int tid, int vpn);
+					// Entry "index" now holds "vpn"
+    int MapAlias(int index, int tid, int vpn);
+					// "vpn" now shares the page of entry
+					// "index"; return the alias entry
+					// used, -1 if none is free
+    int FindAlias(int index);		// Return an alias entry sharing
+					// the page of entry "index", -1 if
+					// there is none
+    int ReplaceWithAlias(int index);	// Give entry "index" to the address
+					// space of one of its aliases, which
+					// is freed; return that space's tid
+    void Unmap(int index);		// Entry "index" is free again
+
+    InvertedTranslationEntry *entries;	// Indexed by physical (or swap)
+					// page number, then the aliases
+    int size;				// Number of entries, not counting
+					// the aliases
+    int numAliases;			// Number of alias entries
+
+  private:
+    int Hash(int tid, int vpn);
+    int *anchors;			// The first entry of each hash chain,
+					// -1 if the chain is empty
+    int freeAliases;			// The first free alias entry; the
+					// others are chained through "next"
 };
 
 #endif
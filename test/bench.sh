@@ -0,0 +1,21 @@
+#!/bin/sh
+# bench.sh
+#	Compare the speed of the two engines that simulate user programs:
+#	the switch-based interpreter (the default) and the threaded-code
+#	engine (-tc), each with and without batched clock ticks (-tb).
+#	For every program, print the simulated MIPS
+#	(user instructions per second of host time) reported by nachos
+#	when it halts.
+#
+#	Run from the test directory, once userprog/nachos has been built:
+#		sh bench.sh [program ...]
+#	The default programs are matmult and sort.
+
+NACHOS=${NACHOS:-../userprog/nachos}
+
+for prog in ${*:-matmult sort}; do
+    for flags in "" "-tb" "-tc" "-tc -tb"; do
+	printf "%-10s %-8s " $prog "$flags"
+	$NACHOS $flags -x $prog | grep "^Engine:"
+    done
+done
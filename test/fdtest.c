@@ -0,0 +1,53 @@
+/* fdtest.c
+ *    Test program for file descriptors: Open hands out the lowest one
+ *    free, Write and Read go through them and fail on ids that are not
+ *    open, and Exit closes what is still open (two files, here).
+ *
+ *    Exits with status 0 if every call did what it should, with the
+ *    number of the failed check otherwise (see paging.sh).
+ */
+
+#include "syscall.h"
+
+#define Size	12	/* bytes in text */
+
+char text[] = "hello, file\n";
+char buffer[Size];
+
+int
+main()
+{
+    OpenFileId first, second, third;
+    int i;
+
+    Create("fdtest.dat");
+    first = Open("fdtest.dat");
+    second = Open("fdtest.dat");
+    if (first != ConsoleOutput + 1 || second != first + 1)
+	Exit(1);
+    Close(first);
+    third = Open("fdtest.dat");		/* gets the id closed above */
+    if (third != first)
+	Exit(2);
+    if (Open("fdtest.none") != -1)
+	Exit(3);
+
+    if (Write(text, Size, third) != Size)
+	Exit(4);
+    if (Write(text, Size, ConsoleInput) != -1 ||
+	Write(text, Size, ConsoleOutput) != -1 ||
+	Write(text, Size, second + 1) != -1 ||
+	Write(text, Size, -1) != -1)
+	Exit(5);
+
+    if (Read(buffer, Size, second) != Size)	/* from the start */
+	Exit(6);
+    for (i = 0; i < Size; i++)
+	if (buffer[i] != text[i])
+	    Exit(7);
+    if (Read(buffer, Size, second) != 0)	/* at the end */
+	Exit(8);
+    if (Read(buffer, Size, second + 1) != -1)
+	Exit(9);
+    Exit(0);
+}
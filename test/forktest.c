@@ -0,0 +1,35 @@
+/* forktest.c
+ *    Test program for Fork: the child runs in a copy-on-write copy of
+ *    the parent's address space, so each of them must see its own
+ *    writes to a global variable, and not the other's.
+ *
+ *    Parent and child exit with status 0 if they saw what they should,
+ *    1 otherwise (see paging.sh).
+ */
+
+#include "syscall.h"
+
+int shared = 1;
+
+void
+child()
+{
+    if (shared != 1)	/* the parent writes it after the Fork */
+	Exit(1);
+    shared = 2;
+    Yield();		/* let the parent run */
+    Exit(shared != 2);
+}
+
+int
+main()
+{
+    SpaceId id;
+
+    id = Fork(child);
+    if (id == -1)
+	Exit(1);
+    shared = 3;
+    Join(id);		/* the child wrote 2 meanwhile */
+    Exit(shared != 3);
+}
@@ -0,0 +1,55 @@
+/* mmaptest.c
+ *    Test program for Mmap: write a file, map it, change every other
+ *    byte through the mapping, unmap it, and read the file back.
+ *    The file spans several pages, so that with little memory some of
+ *    them are written back when they are replaced, before Munmap.
+ *
+ *    Exits with status 0 if the file reads back as it should, with
+ *    the number of the failed check otherwise (see paging.sh).
+ */
+
+#include "syscall.h"
+
+#define Length	1000	/* bytes of the file, all mapped */
+
+char buffer[Length];
+
+int
+main()
+{
+    OpenFileId fd;
+    char *map;
+    int i;
+
+    Create("mmaptest.dat");
+    fd = Open("mmaptest.dat");
+    if (fd == -1)
+	Exit(1);
+    for (i = 0; i < Length; i++)
+	buffer[i] = 'a';
+    if (Write(buffer, Length, fd) != Length)
+	Exit(2);
+
+    map = (char *) Mmap(fd, 0, Length);
+    if (map == (char *) -1)
+	Exit(3);
+    Close(fd);		/* the mapping keeps the file open */
+    for (i = 0; i < Length; i++)
+	if (map[i] != 'a')
+	    Exit(4);
+    for (i = 0; i < Length; i += 2)
+	map[i] = 'b';
+    if (Munmap((int) map) != 0)
+	Exit(5);
+    if (Munmap((int) map) != -1)	/* not mapped any more */
+	Exit(6);
+
+    fd = Open("mmaptest.dat");
+    if (Read(buffer, Length, fd) != Length)
+	Exit(7);
+    for (i = 0; i < Length; i++)
+	if (buffer[i] != (i % 2 == 0 ? 'b' : 'a'))
+	    Exit(8);
+    Close(fd);
+    Exit(0);
+}
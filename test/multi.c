@@ -0,0 +1,24 @@
+/* multi.c
+ *    Test program to run several programs at once, each bigger than
+ *    its share of physical memory.
+ *
+ *    Intention is to stress the resident set limits and the medium-term
+ *    scheduler: run with fewer pages of memory than the children need
+ *    together (see paging.sh).
+ */
+
+#include "syscall.h"
+
+int
+main()
+{
+    SpaceId sort1, sort2, matmult;
+
+    sort1 = Exec("sort");
+    matmult = Exec("matmult");
+    sort2 = Exec("sort");
+    Join(sort1);
+    Join(matmult);
+    Join(sort2);
+    Exit(0);
+}
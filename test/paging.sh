@@ -0,0 +1,72 @@
+#!/bin/sh
+# paging.sh
+#	Run user programs bigger than physical memory, so that pages are
+#	replaced by the faulting thread itself as well as by the page-out
+#	daemon, and check that each run gets to halt.  "-pw 0 0" keeps
+#	the daemon asleep, so that every replacement happens on a fault.
+#
+#	Then run several programs at once (multi), so that they reach
+#	their resident set limits and replace their own pages, and check
+#	that some did.  With less memory than this, the medium-term
+#	scheduler keeps only one of them in memory at a time, and that
+#	one may use all of it.
+#
+#	Last, run the test programs for the system calls that change an
+#	address space or its open files; each of their processes exits
+#	with status 0 if what it checked was right.
+#
+#	Run from the test directory, once userprog/nachos and the test
+#	programs have been built:
+#		sh paging.sh [program ...]
+#	The default programs are matmult and sort.
+
+NACHOS=${NACHOS:-../userprog/nachos}
+status=0
+
+run() {
+    printf "%-10s %-20s " "$1" "$2"
+    if $NACHOS $2 -x $1 2>&1 | grep -q "^Machine halting"; then
+	echo ok
+    else
+	echo FAILED
+	status=1
+    fi
+}
+
+check() {
+    printf "%-10s %-20s " "$1" "$2"
+    out=`$NACHOS $2 -x $1 2>&1`
+    if echo "$out" | grep -q "^Machine halting" &&
+	! echo "$out" | grep "^User program exit" | grep -qv "status 0\."; then
+	echo ok
+    else
+	echo FAILED
+	status=1
+    fi
+}
+
+for prog in ${*:-matmult sort}; do
+    for flags in "-pp 16" "-pp 16 -pw 0 0" "-pp 16 -fa 4" "-pp 8 -pw 0 0"; do
+	run $prog "$flags"
+    done
+done
+
+for flags in "-pp 64" "-pp 64 -pw 0 0"; do
+    printf "%-10s %-20s " multi "$flags"
+    replaced=`$NACHOS $flags -x multi 2>&1 |
+	sed -n 's/^Load control: replaced within resident set \([0-9]*\).*/\1/p'`
+    if [ "${replaced:-0}" -gt 0 ]; then
+	echo "ok ($replaced local replacements)"
+    else
+	echo FAILED
+	status=1
+    fi
+done
+
+for prog in forktest sbrktest mmaptest fdtest; do
+    for flags in "-pp 16" "-pp 8 -pw 0 0"; do
+	check $prog "$flags"
+    done
+done
+rm -f mmaptest.dat fdtest.dat
+exit $status
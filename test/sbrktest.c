@@ -0,0 +1,70 @@
+/* sbrktest.c
+ *    Test program for the parts of the address space that grow: the
+ *    heap, with Sbrk, and the stack, past its initial size
+ *    (UserStackSize) by recursing with big frames.
+ *
+ *    Exits with status 0 if everything read back as it should, with
+ *    the number of the failed check otherwise (see paging.sh).
+ */
+
+#include "syscall.h"
+
+#define HeapSize	4096	/* bytes asked of Sbrk */
+#define Kept		100	/* bytes kept when shrinking the heap */
+#define FrameSize	256	/* words of stack in each call to Recurse */
+#define Depth		16	/* calls to Recurse: 16K bytes of stack */
+
+int
+Recurse(int depth)
+{
+    int frame[FrameSize];
+    int i, sum;
+
+    for (i = 0; i < FrameSize; i++)
+	frame[i] = depth + i;
+    sum = 0;
+    if (depth > 1)
+	sum = Recurse(depth - 1);
+    for (i = 0; i < FrameSize; i++)
+	if (frame[i] != depth + i)
+	    return -1;
+    if (sum == -1)
+	return -1;
+    return sum + depth;
+}
+
+int
+main()
+{
+    char *heap;
+    int i;
+
+    heap = (char *) Sbrk(HeapSize);
+    if (heap == (char *) -1)
+	Exit(1);
+    for (i = 0; i < HeapSize; i++)
+	if (heap[i] != 0)
+	    Exit(2);
+    for (i = 0; i < HeapSize; i++)
+	heap[i] = 1;
+
+    /* shrink the heap to the middle of a page, then grow it back:
+     * what was written past the end must be gone */
+    if (Sbrk(Kept - HeapSize) != (int) heap + HeapSize)
+	Exit(3);
+    if (Sbrk(HeapSize - Kept) != (int) heap + Kept)
+	Exit(4);
+    for (i = 0; i < Kept; i++)
+	if (heap[i] != 1)
+	    Exit(5);
+    for (i = Kept; i < HeapSize; i++)
+	if (heap[i] != 0)
+	    Exit(6);
+
+    if (Sbrk(-(HeapSize + (int) heap)) != -1)	/* below the program */
+	Exit(7);
+
+    if (Recurse(Depth) != Depth * (Depth + 1) / 2)
+	Exit(8);
+    Exit(0);
+}
@@ -242,6 +242,25 @@ List::SortedRemove(int *keyPtr)
     return thing;
 }
 
+//----------------------------------------------------------------------
+// List::SortedPeek
+//      Look at the first "item" of a sorted list, without removing it.
+//
+// Returns:
+//	Pointer to the first item, NULL if nothing on the list.
+//	Sets *keyPtr to the priority value of that item.
+//----------------------------------------------------------------------
+
+void *
+List::SortedPeek(int *keyPtr)
+{
+    if (IsEmpty()) 
+	return NULL;
+    if (keyPtr != NULL)
+        *keyPtr = first->key;
+    return first->item;
+}
+
 
 
 void
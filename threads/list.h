@@ -61,6 +61,7 @@ class List {
     // Routines to put/get items on/off list in order (sorted by key)
     void SortedInsert(void *item, int sortKey);	// Put item into list
     void *SortedRemove(int *keyPtr); 	  	// Remove first item from list
+    void *SortedPeek(int *keyPtr);		// Look at first item on list
 
   private:
     ListElement *first;  	// Head of the list, NULL if list is empty
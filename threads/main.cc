@@ -9,7 +9,9 @@
 // 	Most of this file is not needed until later assignments.
 //
 // Usage: nachos -d <debugflags> -rs <random seed #>
-//		-s -x <nachos file> -c <consoleIn> <consoleOut>
+//		-s -pp <pages> -ps <bytes> -sp <pages>
+//		-ts <policy> -tn <entries> -tw <ways> -th -tc -tb -fa <pages>
+//		-x <nachos file> -c <consoleIn> <consoleOut>
 //		-f -cp <unix file> <nachos file>
 //		-p <nachos file> -r <nachos file> -l -D -t
 //              -n <network reliability> -m <machine id>
@@ -23,6 +25,28 @@
 //  USER_PROGRAM
 //    -s causes user programs to be executed in single-step mode
 //    -x runs a user program
+//    -pp sets the number of pages of main memory (default 32)
+//    -ps sets the page size, in bytes (default SectorSize)
+//    -sp sets the number of pages of swap space (default 1024, or as
+//       many as fit on the swap disk, SWAP)
+//    -ts chooses the TLB replacement policy: LRU, FIFO, RANDOM or CLOCK
+//    -tn sets the number of TLB entries
+//    -tw sets the TLB associativity (1 is direct-mapped, 0 fully associative)
+//    -th lets a hardware page table walker service TLB misses
+//    -tc runs user programs with the threaded-code engine
+//    -tb advances the clock in bulk between interrupts
+//    -fa reads up to this many pages of the executable per page fault
+//    -pw sets the low and high watermarks of free pages for the page-out
+//       daemon (default 1/16 and 1/8 of memory; a low watermark of 0
+//       turns it off)
+//    -sc keeps up to this many pages' worth of compressed swapped-out
+//       pages in memory, instead of on the swap disk (default 0)
+//    -tr records the pages referenced by user programs in this host file,
+//       for bin/pagesim
+//    -pf grows an address space's resident set limit when it faults
+//       within this many instructions, and shrinks it past the second
+//       number (default 1000 and 10000; 0 0 turns limits and swapping
+//       of address spaces off)
 //    -c tests the console
 //
 //  FILESYS
@@ -51,6 +75,11 @@
 #undef MAIN
 
 #include "system.h"
+#ifdef USER_PROGRAM
+#include "pageout.h"
+#include "memsched.h"
+#include "swapdisk.h"
+#endif
 #include "utility.h"
 
 #ifdef THREADS
@@ -122,6 +151,14 @@ int main(int argc, char **argv)
                         {
                             machine->TLBReplaceStrategy = TLB_FIFO;
                         }
+                    else if (!strcmp(*(argv + 1), "RANDOM"))
+                        {
+                            machine->TLBReplaceStrategy = TLB_RANDOM;
+                        }
+                    else if (!strcmp(*(argv + 1), "CLOCK"))
+                        {
+                            machine->TLBReplaceStrategy = TLB_CLOCK;
+                        }
                     else
                         {
                             printf("Unknow TLB replacement strategy, "
@@ -130,6 +167,54 @@ int main(int argc, char **argv)
 
                     argCount = 2;
                 }
+            if (!strcmp(*argv, "-tn"))
+                {  // set the number of TLB entries
+                    ASSERT(argc > 1);
+                    machine->SetTLBGeometry(atoi(*(argv + 1)), machine->TLBWays);
+                    argCount = 2;
+                }
+            if (!strcmp(*argv, "-tw"))
+                {  // set the TLB associativity, 0 for fully associative
+                    ASSERT(argc > 1);
+                    machine->SetTLBGeometry(machine->TLBEntries, atoi(*(argv + 1)));
+                    argCount = 2;
+                }
+            if (!strcmp(*argv, "-th"))  // refill the TLB in hardware on misses to resident pages
+                machine->hardwareWalker = TRUE;
+            if (!strcmp(*argv, "-tc"))  // run user programs with the threaded-code engine
+                machine->useThreadedCode = TRUE;
+            if (!strcmp(*argv, "-tb"))  // only check for interrupts when one may be due
+                machine->batchTicks = TRUE;
+            if (!strcmp(*argv, "-fa"))
+                {  // prefetch the pages after a faulting one
+                    ASSERT(argc > 1);
+                    machine->SetFaultAround(atoi(*(argv + 1)));
+                    argCount = 2;
+                }
+            if (!strcmp(*argv, "-pw"))
+                {  // when the page-out daemon wakes up, and when it stops
+                    ASSERT(argc > 2);
+                    machine->pageOutDaemon->SetWatermarks(atoi(*(argv + 1)), atoi(*(argv + 2)));
+                    argCount = 3;
+                }
+            if (!strcmp(*argv, "-sc"))
+                {  // size of the compressed swap pool, in pages
+                    ASSERT(argc > 1);
+                    machine->swapDisk->SetPoolSize(atoi(*(argv + 1)) * PageSize);
+                    argCount = 2;
+                }
+            if (!strcmp(*argv, "-tr"))
+                {  // trace page references
+                    ASSERT(argc > 1);
+                    machine->StartTrace(*(argv + 1));
+                    argCount = 2;
+                }
+            if (!strcmp(*argv, "-pf"))
+                {  // page-fault frequency thresholds for the resident set limits
+                    ASSERT(argc > 2);
+                    machine->memScheduler->SetFaultIntervals(atoi(*(argv + 1)), atoi(*(argv + 2)));
+                    argCount = 3;
+                }
             if (!strcmp(*argv, "-x"))
                 {  // run a user program
                     ASSERT(argc > 1);
@@ -7,6 +7,9 @@
 
 #include "system.h"
 #include "copyright.h"
+#ifdef USER_PROGRAM
+#include "memsched.h"
+#endif
 
 // This defines *all* of the global data structures used by Nachos.
 // These are all initialized and de-allocated by this file.
@@ -71,6 +74,10 @@ extern void Cleanup();
 //----------------------------------------------------------------------
 static void TimerInterruptHandler(int dummy)
 {
+#ifdef USER_PROGRAM
+    if (machine != NULL)  // let suspended address spaces back in, even
+        machine->memScheduler->ResumeWaiting();  // if no other one faults
+#endif
     if (interrupt->getStatus() != IdleMode && currentThread->getPriority() > 0)
         {
             int runTime = stats->totalTicks - currentThread->getLastStartTime();
@@ -118,6 +125,7 @@ void Initialize(int argc, char **argv)
 
 #ifdef USER_PROGRAM
     bool debugUserProg = FALSE;  // single step user program
+    bool swapSizeGiven = FALSE;
 #endif
 #ifdef FILESYS_NEEDED
     bool format = TRUE;  // format disk
@@ -153,6 +161,25 @@ void Initialize(int argc, char **argv)
 #ifdef USER_PROGRAM
             if (!strcmp(*argv, "-s"))
                 debugUserProg = TRUE;
+            else if (!strcmp(*argv, "-pp"))
+                {
+                    ASSERT(argc > 1);
+                    NumPhysPages = atoi(*(argv + 1));  // size of main memory
+                    argCount = 2;
+                }
+            else if (!strcmp(*argv, "-ps"))
+                {
+                    ASSERT(argc > 1);
+                    PageSize = atoi(*(argv + 1));  // bytes per page
+                    argCount = 2;
+                }
+            else if (!strcmp(*argv, "-sp"))
+                {
+                    ASSERT(argc > 1);
+                    NumSwapPages = atoi(*(argv + 1));  // size of swap space
+                    swapSizeGiven = TRUE;
+                    argCount = 2;
+                }
 #endif
 #ifdef FILESYS_NEEDED
             if (!strcmp(*argv, "-f"))
@@ -194,6 +221,9 @@ void Initialize(int argc, char **argv)
     CallOnUserAbort(Cleanup);  // if user hits ctl-C
 
 #ifdef USER_PROGRAM
+    ASSERT(PageSize > 0 && PageSize % 4 == 0 && NumPhysPages > 0 && NumSwapPages > 0);
+    if (!swapSizeGiven)  // with big pages, fewer fit on the swap disk
+        NumSwapPages = min(NumSwapPages, NumSectors / divRoundUp(PageSize, SectorSize));
     machine = new Machine(debugUserProg);  // this must come first
 #endif
 
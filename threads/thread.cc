@@ -353,8 +353,10 @@ void start_progress(char *filename)
     if (executable == NULL)
         {
             printf("Unable to open file %s\n", filename);
+            delete[] filename;
             return;
         }
+    delete[] filename;  // Exec copied it in for us
     space = new AddrSpace(executable);
     currentThread->space = space;
 
@@ -365,35 +367,27 @@ void start_progress(char *filename)
     ASSERT(FALSE);   // machine->Run never returns;
                      // the address space exits
 }
-#endif
 
-void before_fork(AddrSpacePC *parentSpacePC)
+//----------------------------------------------------------------------
+// before_fork
+// 	Start a process created by Fork: run procedure "PC" in "space", the
+//	copy-on-write copy of the parent's address space.  The thread's
+//	user registers are those of the parent when it called Fork.
+//----------------------------------------------------------------------
+
+void before_fork(AddrSpacePC *childSpacePC)
 {
-    // copy everyting in parentSpace
-    AddrSpace *space = parentSpacePC->space;
-    AddrSpace *newSpace = new AddrSpace(space->execFile);
-    newSpace->numPages = space->numPages;
-    newSpace->pageTable = new TranslationEntry[newSpace->numPages];
-    for (int i = 0; i < newSpace->numPages; ++i)
-        newSpace->pageTable[i] = space->pageTable[i];
-    newSpace->swapPageTable = new TranslationEntry[NumSwapPages];
-    for (int i = 0; i < NumSwapPages; ++i)
-        newSpace->swapPageTable[i] = space->swapPageTable[i];
-    newSpace->execFile = space->execFile;
-    newSpace->offsetVaddrToFile = space->offsetVaddrToFile;
-    newSpace->readOnlyPageStart = space->readOnlyPageStart;
-    newSpace->readOnlyPageEnd = space->readOnlyPageEnd;
-
-
-    currentThread->space = newSpace;
-
-    // copy PC and NextPC
-    machine->WriteRegister(PCReg, parentSpacePC->PC);
-    machine->WriteRegister(NextPCReg, parentSpacePC->PC + 4);
-
-    currentThread->SaveUserState();
+    currentThread->space = childSpacePC->space;
+    currentThread->RestoreUserState();
+    machine->WriteRegister(PCReg, childSpacePC->PC);
+    machine->WriteRegister(NextPCReg, childSpacePC->PC + 4);
+    delete childSpacePC;
+
+    currentThread->space->RestoreState();  // load page table register
     machine->Run();
+    ASSERT(FALSE);
 }
+#endif
 
 void Thread::printStatus()
 {
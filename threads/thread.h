@@ -218,7 +218,7 @@ class Thread
 #ifdef USER_PROGRAM
 void start_progress(char *filename);
 
-void before_fork(AddrSpacePC *parentSpacePC);
+void before_fork(AddrSpacePC *childSpacePC);
 #endif
 
 class ThreadPool
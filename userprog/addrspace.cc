@@ -17,12 +17,15 @@
 
 #include "addrspace.h"
 #include "copyright.h"
-#include "noff.h"
 #include "system.h"
+#include "swapdisk.h"
+#include "memsched.h"
 #ifdef HOST_SPARC
 #include <strings.h>
 #endif
 
+AddrSpace *AddrSpace::spaces[MaxAddrSpaces];
+
 //----------------------------------------------------------------------
 // SwapHeader
 // 	Do little endian to big endian conversion on the bytes in the
@@ -62,53 +65,54 @@ static void SwapHeader(NoffHeader *noffH)
 AddrSpace::AddrSpace(OpenFile *executable)
 {
     NoffHeader noffH;
-    unsigned int i, size;
+    unsigned int size;
 
     execFile = executable;
+    execFileId = executable->FileId();
+    execFileUsers = new int(1);
+    AllocateIds();
 
     executable->ReadAt((char *)&noffH, sizeof(noffH), 0);
     if ((noffH.noffMagic != NOFFMAGIC) && (WordToHost(noffH.noffMagic) == NOFFMAGIC))
         SwapHeader(&noffH);
     ASSERT(noffH.noffMagic == NOFFMAGIC);
 
-    // how big is address space?
-    size = noffH.code.size + noffH.initData.size + noffH.uninitData.size +
-           UserStackSize;  // we need to increase the size
-                           // to leave room for the stack
-    numPages = divRoundUp(size, PageSize);
-    size = numPages * PageSize;
+    // how big is the program?  The address space itself is always
+    // UserSpaceSize: the heap grows up from the end of the program
+    // (Sbrk), the stack down from the top (see ValidateFault), and
+    // files are mapped below the stack (MapFile)
+    size = noffH.code.size + noffH.initData.size + noffH.uninitData.size;
+    numPages = divRoundUp(UserSpaceSize, PageSize);
+    brk = heapStart = divRoundUp(size, PageSize) * PageSize;
+    stackBottom = numPages - divRoundUp(UserStackSize, PageSize);
+    stackLimit = numPages - divRoundUp(MaxStackSize, PageSize);
+    mapBottom = stackLimit;
+    ASSERT(divRoundUp(brk, PageSize) <= stackLimit);
 
     printf("    Loading memory\n");
-    printf("    Virtual pages num:  %d\n", numPages);
+    printf("    Virtual pages num:  %d (program %d)\n", numPages, divRoundUp(size, PageSize));
     printf("    Physical pages num:  %d\n", NumPhysPages);
 
-    // ASSERT(numPages <= NumPhysPages);  // check we're not trying
-    // to run anything too big --
-    // at least until we have
-    // virtual memory
-
     DEBUG('a', "Initializing address space, num pages %d, size %d\n", numPages, size);
-    // first, set up the translation
-    pageTable = new TranslationEntry[numPages];
-    for (i = 0; i < numPages; i++)
-        {
-            pageTable[i].valid = FALSE;
-            pageTable[i].use = FALSE;
-            pageTable[i].dirty = FALSE;
-            pageTable[i].readOnly = FALSE;  // if the code segment was entirely on
-                                            // a separate page, we could set its
-                                            // pages to be read-only
-        }
-
-    offsetVaddrToFile = noffH.code.inFileAddr - noffH.code.virtualAddr;
-
-    readOnlyPageStart = (unsigned int)noffH.code.virtualAddr / PageSize;
-    // readOnlyPageEnd = (((unsigned int)noffH.code.virtualAddr + noffH.code.size - 1) / PageSize) +
-    // 1;
-    readOnlyPageEnd = 0;  // unknow read only segment positon
+    // there is nothing to set up for the translation: our pages get
+    // into the inverted page table (keyed on spaceId) as they are loaded,
+    // so the untouched parts of the address space cost nothing; all we
+    // need is where their contents come from
+    numSegments = 0;
+    AddSegment(noffH.code.virtualAddr, noffH.code.size, noffH.code.inFileAddr);
+    AddSegment(noffH.initData.virtualAddr, noffH.initData.size, noffH.initData.inFileAddr);
+    AddSegment(noffH.uninitData.virtualAddr, noffH.uninitData.size, -1);
+    for (int i = 0; i < MaxMappings; ++i)
+        mappings[i].file = NULL;
+    for (int fd = 0; fd < MaxOpenFiles; ++fd)
+        files[fd] = NULL;
 
-    pageTable = new TranslationEntry[numPages];
-    swapPageTable = new TranslationEntry[numPages];
+    // the pages entirely within the code segment are never written:
+    // they are mapped read-only, and shared by every address space
+    // running the program (see Machine::ShareText); the last one may
+    // hold initialized data too
+    readOnlyPageStart = divRoundUp(noffH.code.virtualAddr, PageSize);
+    readOnlyPageEnd = (noffH.code.virtualAddr + noffH.code.size) / PageSize;
 
     // // then, copy in the code and data segments into memory
     //     if (noffH.code.size > 0) {
@@ -126,26 +130,456 @@ AddrSpace::AddrSpace(OpenFile *executable)
 }
 
 //----------------------------------------------------------------------
-// AddrSpace::~AddrSpace
-// 	Dealloate an address space.  Nothing for now!
+// AddrSpace::AddrSpace
+// 	Create a copy of address space "parent", the running one, for a
+//	process it forks.  The copy has the same layout and executable;
+//	its pages are those of "parent", shared until one of the two
+//	writes them (see Machine::ShareSpace), so this costs no copying.
+//	The files "parent" maps stay mapped in the copy, at the same
+//	addresses; the copy writes its dirty pages back to them too.  The
+//	copy has the same file descriptors, referring to the same open
+//	files.
 //----------------------------------------------------------------------
 
-AddrSpace::~AddrSpace()
+AddrSpace::AddrSpace(AddrSpace *parent)
+{
+    execFile = parent->execFile;
+    execFileId = parent->execFileId;
+    execFileUsers = parent->execFileUsers;
+    (*execFileUsers)++;
+    AllocateIds();
+
+    numPages = parent->numPages;
+    heapStart = parent->heapStart;
+    brk = parent->brk;
+    stackBottom = parent->stackBottom;
+    stackLimit = parent->stackLimit;
+    mapBottom = parent->mapBottom;
+    numSegments = parent->numSegments;
+    for (int i = 0; i < numSegments; ++i)
+        segments[i] = parent->segments[i];
+    for (int i = 0; i < MaxMappings; ++i)
+        {
+            mappings[i] = parent->mappings[i];
+            if (mappings[i].file != NULL)
+                mappings[i].file->refCount++;
+        }
+    for (int fd = 0; fd < MaxOpenFiles; ++fd)
+        {
+            files[fd] = parent->files[fd];
+            if (files[fd] != NULL)
+                files[fd]->refCount++;
+        }
+    readOnlyPageStart = parent->readOnlyPageStart;
+    readOnlyPageEnd = parent->readOnlyPageEnd;
+
+    machine->ShareSpace(parent, this);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AllocateIds
+// 	Get a spaceId, under which our pages are entered in the page
+//	tables, and an ASID for our TLB entries.  A spaceId is reused
+//	once its address space is gone, so that Lookup is quick.  Also
+//	let the medium-term scheduler know about us.
+//----------------------------------------------------------------------
+
+void AddrSpace::AllocateIds()
 {
-    // write back dirty pages
+    for (spaceId = 0; spaceId < MaxAddrSpaces; ++spaceId)
+        if (spaces[spaceId] == NULL)
+            break;
+    ASSERT(spaceId < MaxAddrSpaces);
+    spaces[spaceId] = this;
+    asid = machine->asidStatusMap->Find();  // NoASID if all are taken
+    userTicks = 0;
+    runStart = stats->userTicks;
+    machine->memScheduler->Admit(this);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Lookup
+// 	Return the address space whose spaceId is "id", NULL if there is
+//	none.
+//----------------------------------------------------------------------
 
-    // recycle used physical memoryF
-    for (int i = 0; i < numPages; ++i)
+AddrSpace *AddrSpace::Lookup(int id)
+{
+    ASSERT(id >= 0 && id < MaxAddrSpaces);
+    return spaces[id];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddSegment
+// 	Record a segment of the address space, unless it is empty.
+//	"inFileAddr" is -1 for a segment that starts out zero-filled.
+//----------------------------------------------------------------------
+
+void AddrSpace::AddSegment(int virtualAddr, int size, int inFileAddr)
+{
+    if (size <= 0)
+        return;
+    ASSERT(numSegments < MaxSegments);
+    DEBUG('a', "Segment at 0x%x, size %d, %s\n", virtualAddr, size,
+          inFileAddr >= 0 ? "from the executable" : "zero-filled");
+    segments[numSegments].virtualAddr = virtualAddr;
+    segments[numSegments].size = size;
+    segments[numSegments].inFileAddr = inFileAddr;
+    numSegments++;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::IsZeroFill
+// 	Return TRUE if page "vpn" starts out all zeros: no segment read
+//	from the executable overlaps it.  Such a page (uninitialized data,
+//	stack) is loaded by clearing a frame, without reading the file.
+//----------------------------------------------------------------------
+
+bool AddrSpace::IsZeroFill(int vpn)
+{
+    int start = vpn * PageSize;
+
+    for (int i = 0; i < numSegments; ++i)
         {
-            if (pageTable[i].valid)
+            Segment *seg = &segments[i];
+            if (seg->inFileAddr >= 0 && seg->virtualAddr < start + PageSize &&
+                start < seg->virtualAddr + seg->size)
+                return FALSE;
+        }
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReadPages
+// 	Put the initial contents of "count" consecutive pages, starting
+//	at page "vpn", into "into": bytes of segments read from the
+//	executable are read from it, with one ReadAt per segment, and
+//	everything else is zero.
+//----------------------------------------------------------------------
+
+void AddrSpace::ReadPages(int vpn, int count, char *into)
+{
+    int start = vpn * PageSize, end = (vpn + count) * PageSize;
+
+    memset(into, 0, count * PageSize);
+    for (int i = 0; i < numSegments; ++i)
+        {
+            Segment *seg = &segments[i];
+            int from = max(start, seg->virtualAddr);
+            int to = min(end, seg->virtualAddr + seg->size);
+            if (seg->inFileAddr >= 0 && from < to)
+                execFile->ReadAt(&into[from - start], to - from,
+                                 seg->inFileAddr + (from - seg->virtualAddr));
+        }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ValidateFault
+// 	The running address space faulted at "virtAddr".  Return TRUE if
+//	the page is part of the address space: the program, the heap, the
+//	stack, or a mapped file.  An address just below the stack, but
+//	not below the stack pointer, is taken to be a push: the stack
+//	grows down to it, up to MaxStackSize.  Return FALSE otherwise.
+//----------------------------------------------------------------------
+
+bool AddrSpace::ValidateFault(int virtAddr)
+{
+    int vpn = (unsigned)virtAddr / PageSize;
+
+    if (vpn < divRoundUp(brk, PageSize) || (vpn >= stackBottom && vpn < (int)numPages) ||
+        FindMapping(vpn) != NULL)
+        return TRUE;
+    if (vpn >= stackLimit && vpn < stackBottom &&
+        (unsigned)virtAddr >= (unsigned)machine->ReadRegister(StackReg))
+        {
+            DEBUG('a', "Stack grown from page %d down to page %d\n", stackBottom, vpn);
+            stackBottom = vpn;
+            return TRUE;
+        }
+    return FALSE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::Sbrk
+// 	Move the end of the heap by "increment" bytes (which may be
+//	negative), and return where it was, or -1 if it cannot move
+//	there: below the program, or into the mappings.  New heap pages
+//	are zero, and only take memory once touched; the pages the heap
+//	no longer covers are given back.  The rest of the heap's last
+//	page is zeroed, so that the heap reads as zero if it grows again.
+//
+//	Called for the running address space only.
+//----------------------------------------------------------------------
+
+int AddrSpace::Sbrk(int increment)
+{
+    int old = brk;
+    int end = brk + increment;
+    char zeros[PageSize];
+
+    if (end < heapStart || divRoundUp(end, PageSize) > mapBottom)
+        return -1;
+    if (end < old && end % PageSize != 0)
+        {
+            int count = min(old, divRoundUp(end, PageSize) * PageSize) - end;
+            memset(zeros, 0, count);
+            machine->CopyOut(zeros, end, count);
+        }
+    for (int vpn = divRoundUp(end, PageSize); vpn < divRoundUp(old, PageSize); ++vpn)
+        {
+            machine->InvalidateTLBPage(asid, vpn);
+            if (machine->currentSpaceId == spaceId)
+                machine->InvalidateTranslation(vpn);
+            machine->ReleasePage(spaceId, vpn);
+        }
+    brk = end;
+    return old;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::AddFile
+// 	Give "file", just opened by the program, the lowest free file
+//	descriptor, and return it; -1 if they are all in use, in which
+//	case the caller still owns "file".
+//----------------------------------------------------------------------
+
+int AddrSpace::AddFile(OpenFile *file)
+{
+    for (int fd = FirstFileId; fd < MaxOpenFiles; ++fd)
+        if (files[fd] == NULL)
+            {
+                files[fd] = new SharedFile;
+                files[fd]->file = file;
+                files[fd]->refCount = 1;
+                return fd;
+            }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::GetFile
+// 	Return the open file of file descriptor "fd", NULL if "fd" is not
+//	an open descriptor.
+//----------------------------------------------------------------------
+
+SharedFile *AddrSpace::GetFile(int fd)
+{
+    if (fd < 0 || fd >= MaxOpenFiles)
+        return NULL;
+    return files[fd];
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CloseFile
+// 	Free file descriptor "fd".  Its file is closed once no other
+//	descriptor (of an address space forked from or with this one),
+//	and no mapping, refers to it.  Return FALSE if "fd" was not open.
+//----------------------------------------------------------------------
+
+bool AddrSpace::CloseFile(int fd)
+{
+    SharedFile *file = GetFile(fd);
+    if (file == NULL)
+        return FALSE;
+    files[fd] = NULL;
+    ReleaseFile(file);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::CloseFiles
+// 	Free all of our file descriptors, the program leaving them open
+//	or not.  Called when the program exits.
+//----------------------------------------------------------------------
+
+void AddrSpace::CloseFiles()
+{
+    for (int fd = 0; fd < MaxOpenFiles; ++fd)
+        if (files[fd] != NULL)
+            CloseFile(fd);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::ReleaseFile
+// 	A descriptor or a mapping no longer refers to "file"; close it if
+//	it was the last.
+//----------------------------------------------------------------------
+
+void AddrSpace::ReleaseFile(SharedFile *file)
+{
+    if (--file->refCount == 0)
+        {
+            delete file->file;
+            delete file;
+        }
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::MapFile
+// 	Map "length" bytes of "file", starting at "offset" in it, into
+//	new pages just below the lowest mapping (or the stack).  Nothing
+//	is read now: the pages are read from the file as they fault in
+//	(see Machine::PageLoad).  Return the virtual address of the
+//	mapping, or -1 if there are too many of them already, or it would
+//	run into the heap.
+//
+//	The mapping keeps the file open, even once its descriptor is
+//	closed.
+//----------------------------------------------------------------------
+
+int AddrSpace::MapFile(SharedFile *file, int offset, int length)
+{
+    if (file == NULL || offset < 0 || length <= 0 ||
+        mapBottom - divRoundUp(length, PageSize) < divRoundUp(brk, PageSize))
+        return -1;
+    for (int i = 0; i < MaxMappings; ++i)
+        if (mappings[i].file == NULL)
+            {
+                Mapping *m = &mappings[i];
+                m->numPages = divRoundUp(length, PageSize);
+                m->vpn = mapBottom - m->numPages;
+                m->file = file;
+                file->refCount++;
+                m->offset = offset;
+                m->length = length;
+                mapBottom = m->vpn;
+                DEBUG('a', "Mapped %d bytes at offset %d at page %d\n", length, offset, m->vpn);
+                return m->vpn * PageSize;
+            }
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::UnmapFile
+// 	Remove the mapping starting at "virtAddr".  Its pages that are in
+//	memory, and dirty, are written back to the file first, unless
+//	other address spaces share them (after a Fork); they write them
+//	back themselves.  If the mapping was the lowest, the heap may
+//	grow into its pages again.  Return FALSE if there is no such
+//	mapping.
+//----------------------------------------------------------------------
+
+bool AddrSpace::UnmapFile(int virtAddr)
+{
+    Mapping *m = FindMapping((unsigned)virtAddr / PageSize);
+    if (m == NULL || m->vpn * PageSize != virtAddr)
+        return FALSE;
+
+    for (int vpn = m->vpn; vpn < m->vpn + m->numPages; ++vpn)
+        {
+            machine->InvalidateTLBPage(asid, vpn);  // gets the dirty bit
+            if (machine->currentSpaceId == spaceId)
+                machine->InvalidateTranslation(vpn);
+            int index = machine->pageTable->Lookup(spaceId, vpn);
+            if (index != -1)
                 {
-                    machine->memStatusMap->Clear(pageTable[i].physicalPage);
+                    int physPage = machine->pageTable->entries[index].physicalPage;
+                    InvertedTranslationEntry *entry = &machine->pageTable->entries[physPage];
+                    if (entry->backing == MappedFile && entry->dirty &&
+                        machine->coreMap->entries[physPage].refCount == 1)
+                        {
+                            machine->coreMap->Pin(physPage);  // the write may wait
+                            WriteMappedPage(vpn, &machine->mainMemory[physPage * PageSize]);
+                            machine->coreMap->Unpin(physPage);
+                        }
                 }
+            machine->ReleasePage(spaceId, vpn);
+        }
+
+    ReleaseFile(m->file);
+    m->file = NULL;
+    mapBottom = stackLimit;
+    for (int i = 0; i < MaxMappings; ++i)
+        if (mappings[i].file != NULL)
+            mapBottom = min(mapBottom, mappings[i].vpn);
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::UnmapFiles
+// 	Remove all of our mappings, writing our dirty pages of them back
+//	to the files.  Called when the program exits.
+//----------------------------------------------------------------------
+
+void AddrSpace::UnmapFiles()
+{
+    for (int i = 0; i < MaxMappings; ++i)
+        if (mappings[i].file != NULL)
+            UnmapFile(mappings[i].vpn * PageSize);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::FindMapping
+// 	Return the mapping page "vpn" belongs to, NULL if none.
+//----------------------------------------------------------------------
+
+Mapping *AddrSpace::FindMapping(int vpn)
+{
+    for (int i = 0; i < MaxMappings; ++i)
+        {
+            Mapping *m = &mappings[i];
+            if (m->file != NULL && vpn >= m->vpn && vpn < m->vpn + m->numPages)
+                return m;
         }
+    return NULL;
+}
 
-    delete[] pageTable;
-    delete[] swapPageTable;
-    delete execFile;
+//----------------------------------------------------------------------
+// AddrSpace::ReadMappedPage
+// 	Read mapped page "vpn" from its file into "into".  Past the end of
+//	the mapping, or of the file, the page is zero.
+//----------------------------------------------------------------------
+
+void AddrSpace::ReadMappedPage(int vpn, char *into)
+{
+    Mapping *m = FindMapping(vpn);
+    int position = (vpn - m->vpn) * PageSize;
+
+    memset(into, 0, PageSize);
+    m->file->file->ReadAt(into, min(PageSize, m->length - position), m->offset + position);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::WriteMappedPage
+// 	Write mapped page "vpn", from "from", back to its file; only the
+//	bytes within the mapping are written.
+//----------------------------------------------------------------------
+
+void AddrSpace::WriteMappedPage(int vpn, char *from)
+{
+    Mapping *m = FindMapping(vpn);
+    int position = (vpn - m->vpn) * PageSize;
+
+    m->file->file->WriteAt(from, min(PageSize, m->length - position), m->offset + position);
+}
+
+//----------------------------------------------------------------------
+// AddrSpace::~AddrSpace
+// 	Dealloate an address space: give back its physical pages, its swap
+//	space and its ASID.  Pages shared with address spaces forked from
+//	(or with) this one stay, for them.  The files we still map get
+//	our dirty pages of them back, and the file descriptors the
+//	program left open are closed.
+//----------------------------------------------------------------------
+
+AddrSpace::~AddrSpace()
+{
+    machine->InvalidateTLBSpace(asid);  // shoot down our TLB entries
+    if (asid != NoASID)
+        machine->asidStatusMap->Clear(asid);
+    UnmapFiles();
+    CloseFiles();
+
+    // recycle used physical memory and swap space
+    machine->ReleaseSpace(spaceId);
+    spaces[spaceId] = NULL;
+    machine->memScheduler->Remove(this);
+
+    if (--(*execFileUsers) == 0)
+        {
+            delete execFile;
+            delete execFileUsers;
+        }
 }
 
 //----------------------------------------------------------------------
@@ -179,25 +613,41 @@ void AddrSpace::InitRegisters()
     DEBUG('a', "Initializing stack register to %d\n", numPages * PageSize - 16);
 }
 
+//----------------------------------------------------------------------
+// AddrSpace::VirtualTime
+// 	Return the number of user instructions we have run so far.  We
+//	must be running.
+//----------------------------------------------------------------------
+
+int AddrSpace::VirtualTime()
+{
+    return userTicks + stats->userTicks - runStart;
+}
+
 //----------------------------------------------------------------------
 // AddrSpace::SaveState
 // 	On a context switch, save any machine state, specific
 //	to this address space, that needs saving.
 //
-//	For now, nothing!
+//	Our TLB entries are tagged with our ASID, so they can stay in the
+//	TLB; only their dirty bits are written back to the page table.
+//	Without an ASID, our entries would be taken for the next address
+//	space's, so they are invalidated.
 //----------------------------------------------------------------------
 
 void AddrSpace::SaveState()
 {
+    userTicks += stats->userTicks - runStart;
     if (machine->tlb != NULL)
         {
-            for (int i = 0; i < TLBSize; ++i)  // clear TLB
+            for (int i = 0; i < machine->TLBEntries; ++i)
                 {
-                    if (machine->tlb[i].valid)
+                    if (machine->tlb[i].valid && machine->tlb[i].asid == asid)
                         {
-                            machine->pageTable[machine->tlb[i].virtualPage].dirty =
+                            machine->pageTable->entries[machine->tlb[i].physicalPage].dirty =
                                 machine->tlb[i].dirty;
-                            machine->tlb[i].valid = false;
+                            if (asid == NoASID)
+                                machine->tlb[i].valid = false;
                         }
                 }
         }
@@ -208,17 +658,16 @@ void AddrSpace::SaveState()
 // 	On a context switch, restore the machine state so that
 //	this address space can run.
 //
-//      For now, tell the machine where to find the page table.
+//      For now, tell the machine which pages of the page tables are ours.
 //----------------------------------------------------------------------
 
 void AddrSpace::RestoreState()
 {
-    machine->pageTable = pageTable;
+    runStart = stats->userTicks;
+    machine->currentSpaceId = spaceId;
     machine->pageTableSize = numPages;
-    machine->swapPageTable = swapPageTable;
-    machine->swapPageTableSize = NumSwapPages;
-    machine->execFile = execFile;
-    machine->offsetVaddrToFile = offsetVaddrToFile;
     machine->readOnlyPageStart = readOnlyPageStart;
     machine->readOnlyPageEnd = readOnlyPageEnd;
+    machine->currentASID = asid;
+    machine->FlushTranslationCache();
 }
@@ -15,9 +15,44 @@
 
 #include "copyright.h"
 #include "filesys.h"
+#include "noff.h"
 #include "translate.h"
 
-#define UserStackSize 1024  // increase this as necessary!
+#define UserStackSize 1024  // initial stack, grown on faults
+#define MaxStackSize (64 * 1024)  // the stack can grow to this
+#define UserSpaceSize (16 * 1024 * 1024)  // bytes of virtual address
+                                          // space, mostly unused
+#define MaxSegments 3       // code, initialized data, uninitialized
+                            // data
+#define MaxAddrSpaces 128   // address spaces that can exist at once
+#define MaxMappings 8       // files an address space can map at once
+#define MaxOpenFiles 16     // file descriptors of an address space
+#define FirstFileId 2       // 0 and 1 are the console (see syscall.h)
+
+class Semaphore;
+
+// An open file, as file descriptors and mappings refer to it.  The
+// address spaces forked from one share its open files, seek position
+// included; the last reference to go closes the file.
+
+struct SharedFile
+{
+    OpenFile *file;  // The file, with its seek position
+    int refCount;    // Descriptors and mappings referring to it
+};
+
+// A region of the address space mapped to part of a file, by Mmap: its
+// pages are read from the file when they fault in, and written back
+// to it when they leave memory dirty.
+
+struct Mapping
+{
+    int vpn;           // First page of the region
+    int numPages;      // Pages in the region
+    SharedFile *file;  // The file mapped, NULL if the slot is free
+    int offset;        // Where in the file the region starts
+    int length;        // Bytes of the file mapped
+};
 
 class AddrSpace
 {
@@ -25,23 +60,110 @@ class AddrSpace
     AddrSpace(OpenFile *executable);  // Create an address space,
                                       // initializing it with the program
                                       // stored in the file "executable"
+    AddrSpace(AddrSpace *parent);     // Create a copy of address space
+                                      // "parent", sharing its pages
+                                      // copy-on-write (Fork)
     ~AddrSpace();                     // De-allocate an address space
 
+    static AddrSpace *Lookup(int spaceId);  // The address space with
+                                            // this spaceId, NULL if none
+
     void InitRegisters();  // Initialize user-level CPU registers,
                            // before jumping to user code
 
     void SaveState();     // Save/restore address space-specific
     void RestoreState();  // info on a context switch
+    int VirtualTime();    // User instructions we have run so far
+
+    bool IsZeroFill(int vpn);  // Is page "vpn" all zeros to start
+                               // with (no byte of it comes from the
+                               // executable)?
+    void ReadPages(int vpn, int count, char *into);
+                               // Read the initial contents of "count"
+                               // pages, starting at page "vpn", from
+                               // the executable
+
+    bool ValidateFault(int virtAddr);
+                               // Is the page at "virtAddr" ours?  It
+                               // may be, by growing the stack
+    int Sbrk(int increment);   // Grow (or shrink) the heap, return
+                               // where it ended, -1 on failure
+
+    int AddFile(OpenFile *file);
+                               // Give "file", just opened, a file
+                               // descriptor; return it, -1 if none
+                               // is free
+    SharedFile *GetFile(int fd);
+                               // The open file of descriptor "fd",
+                               // NULL if it is not open
+    bool CloseFile(int fd);    // Free descriptor "fd", closing its
+                               // file if nothing else refers to it
+    void CloseFiles();         // Free all of them (at Exit)
 
-    TranslationEntry *pageTable;  // Assume linear page table translation
-                                  // for now!
+    int MapFile(SharedFile *file, int offset, int length);
+                               // Map "length" bytes of "file", from
+                               // "offset", below the stack and the
+                               // other mappings; return their address
+    bool UnmapFile(int virtAddr);
+                               // Remove the mapping at "virtAddr",
+                               // writing its dirty pages back
+    void UnmapFiles();         // Remove all of them (at Exit)
+    Mapping *FindMapping(int vpn);
+                               // The mapping page "vpn" is in, if any
+    void ReadMappedPage(int vpn, char *into);
+    void WriteMappedPage(int vpn, char *from);
+                               // Read or write the part of its file
+                               // that mapped page "vpn" holds
+
+    int spaceId;                  // Identifies our pages in the inverted
+                                  // page tables (machine->pageTable,
+                                  // machine->swapPageTable)
     unsigned int numPages;        // Number of pages in the virtual
                                   // address space
-    TranslationEntry *swapPageTable;  // page table for swap space
-    OpenFile *execFile;   // opened exec
-    int offsetVaddrToFile; // offset from virtual address to address in file
+    OpenFile *execFile;   // opened exec, shared with the address
+                          // spaces forked from this one
+    int execFileId;       // execFile->FileId(): our text pages are
+                          // cached in the core map under it
+    Segment segments[MaxSegments];  // Layout of the address space, from
+    int numSegments;                // the NOFF header; the inFileAddr of
+                                    // a zero-filled segment is -1
     int readOnlyPageStart;
     int readOnlyPageEnd;
+    int asid;  // tag of our TLB entries, NoASID if there was none left
+    Mapping mappings[MaxMappings];  // Files mapped by Mmap
+    SharedFile *files[MaxOpenFiles];  // Indexed by file descriptor,
+                                      // NULL if the descriptor is free
+
+    // the dynamic parts of the layout, from the bottom up: the heap,
+    // the mappings, and the stack, with unused pages in between
+    int heapStart;    // End of the program, where the heap starts
+    int brk;          // End of the heap, in bytes
+    int mapBottom;    // Lowest page of the mappings, stackLimit if none
+    int stackLimit;   // Lowest page the stack may grow down to
+    int stackBottom;  // Lowest page of the stack so far
+
+    // for the medium-term scheduler (see memsched.h)
+    int residentLimit;   // frames we may hold, following our
+                         // page-fault frequency
+    int lastFaultTime;   // VirtualTime of our last page fault
+    bool suspended;      // swapped out, waiting for room in memory
+    bool blocked;        // waiting for a child (Join), so not
+                         // needing any memory meanwhile
+    int swapTime;        // when we were last let in or suspended
+    Semaphore *resumed;  // our thread waits on it while suspended
+
+  private:
+    void AddSegment(int virtualAddr, int size, int inFileAddr);
+    void AllocateIds();      // Get a spaceId and an ASID
+    static void ReleaseFile(SharedFile *file);
+                             // Drop a reference to "file"
+    int *execFileUsers;      // Number of address spaces sharing
+                             // execFile; the last one closes it
+    int userTicks;           // User instructions run up to the last
+                             // time we were switched out
+    int runStart;            // stats->userTicks when we were last
+                             // switched in
+    static AddrSpace *spaces[MaxAddrSpaces];  // Indexed by spaceId
 };
 
 struct AddrSpacePC
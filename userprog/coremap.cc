@@ -0,0 +1,268 @@
+// coremap.cc
+//	Routines to keep track of which address space and virtual page
+//	every physical page holds.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "coremap.h"
+#include "addrspace.h"
+
+//----------------------------------------------------------------------
+// CoreMap::CoreMap
+// 	Initialize a core map with "numFrames" frames, all of them free.
+//----------------------------------------------------------------------
+
+CoreMap::CoreMap(int numFrames)
+{
+    size = numFrames;
+    entries = new CoreMapEntry[size];
+    for (int i = 0; i < size; i++) {
+	entries[i].owner = NULL;
+	entries[i].virtualPage = -1;
+	entries[i].pinned = FALSE;
+	entries[i].refCount = 0;
+	entries[i].fileId = -1;
+	entries[i].nextText = -1;
+    }
+    freeMap = new BitMap(size);
+    textAnchors = new int[size];
+    for (int i = 0; i < size; i++)
+	textAnchors[i] = -1;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::~CoreMap
+// 	De-allocate the core map.
+//----------------------------------------------------------------------
+
+CoreMap::~CoreMap()
+{
+    delete [] entries;
+    delete freeMap;
+    delete [] textAnchors;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Allocate
+// 	Find a free frame, and record that it holds virtual page "vpn"
+//	of address space "owner".  Return the frame, or -1 if every frame
+//	is in use; the caller must then replace a page.
+//----------------------------------------------------------------------
+
+int
+CoreMap::Allocate(AddrSpace *owner, int vpn)
+{
+    int frame = freeMap->Find();
+
+    if (frame != -1)
+	Assign(frame, owner, vpn);
+    return frame;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Assign
+// 	Record that frame "frame", which is in use, now holds virtual
+//	page "vpn" of address space "owner", and no other's.  The caller
+//	replacing the page of a frame keeps the frame pinned while it
+//	pages the old page out, and still has it pinned here.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Assign(int frame, AddrSpace *owner, int vpn)
+{
+    ASSERT(freeMap->Test(frame));
+    UncacheText(frame);
+    entries[frame].owner = owner;
+    entries[frame].virtualPage = vpn;
+    entries[frame].refCount = 1;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Free
+// 	Give frame "frame" back; it no longer holds any page.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Free(int frame)
+{
+    ASSERT(freeMap->Test(frame) && !entries[frame].pinned);
+    UncacheText(frame);
+    entries[frame].owner = NULL;
+    entries[frame].virtualPage = -1;
+    entries[frame].refCount = 0;
+    freeMap->Clear(frame);
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Share, CoreMap::Unshare
+// 	Record that one more address space maps frame "frame", or one
+//	less, "owner" being the one whose page table entry it is now.
+//	Unshare never drops the last one: the frame is freed instead.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Share(int frame)
+{
+    ASSERT(freeMap->Test(frame));
+    entries[frame].refCount++;
+}
+
+void
+CoreMap::Unshare(int frame, AddrSpace *owner)
+{
+    ASSERT(entries[frame].refCount > 1 && owner != NULL);
+    entries[frame].owner = owner;
+    entries[frame].refCount--;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::CacheText
+// 	Record that frame "frame", in use, holds a page of the text of
+//	the executable identified by "fileId" -- the page it holds as
+//	virtual page entries[frame].virtualPage, since every address space
+//	running the executable has the same layout.  Until the frame is
+//	freed or reused, FindText finds it -- unless another frame was
+//	holding the page already (both were read at the same time), in
+//	which case FindText keeps finding that one.
+//----------------------------------------------------------------------
+
+void
+CoreMap::CacheText(int frame, int fileId)
+{
+    int bucket = TextHash(fileId, entries[frame].virtualPage);
+
+    ASSERT(freeMap->Test(frame) && entries[frame].fileId == -1);
+    if (FindText(fileId, entries[frame].virtualPage) != -1)
+	return;
+    entries[frame].fileId = fileId;
+    entries[frame].nextText = textAnchors[bucket];
+    textAnchors[bucket] = frame;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::FindText
+// 	Return the frame holding text page "vpn" of the executable
+//	identified by "fileId", or -1 if no frame does.
+//----------------------------------------------------------------------
+
+int
+CoreMap::FindText(int fileId, int vpn)
+{
+    for (int i = textAnchors[TextHash(fileId, vpn)]; i != -1; i = entries[i].nextText)
+	if (entries[i].fileId == fileId && entries[i].virtualPage == vpn)
+	    return i;
+    return -1;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::UncacheText
+// 	Take frame "frame" off its hash chain of cached text pages, if it
+//	is on one: its contents are about to change.
+//----------------------------------------------------------------------
+
+void
+CoreMap::UncacheText(int frame)
+{
+    int *link;
+
+    if (entries[frame].fileId == -1)
+	return;
+    link = &textAnchors[TextHash(entries[frame].fileId, entries[frame].virtualPage)];
+    while (*link != frame)
+	link = &entries[*link].nextText;
+    *link = entries[frame].nextText;
+    entries[frame].fileId = -1;
+    entries[frame].nextText = -1;
+}
+
+int
+CoreMap::TextHash(int fileId, int vpn)
+{
+    return (unsigned)(fileId * 131 + vpn) % size;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Pin, CoreMap::Unpin
+// 	Keep frame "frame" from being chosen for replacement, or allow
+//	it again.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Pin(int frame)
+{
+    ASSERT(entries[frame].owner != NULL && !entries[frame].pinned);
+    entries[frame].pinned = TRUE;
+}
+
+void
+CoreMap::Unpin(int frame)
+{
+    ASSERT(entries[frame].pinned);
+    entries[frame].pinned = FALSE;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::NumFree
+// 	Return the number of free frames.
+//----------------------------------------------------------------------
+
+int
+CoreMap::NumFree()
+{
+    return freeMap->NumClear();
+}
+
+//----------------------------------------------------------------------
+// CoreMap::NumResident
+// 	Return the number of frames held by address space "owner".
+//----------------------------------------------------------------------
+
+int
+CoreMap::NumResident(AddrSpace *owner)
+{
+    int count = 0;
+
+    for (int i = 0; i < size; i++)
+	if (entries[i].owner == owner)
+	    count++;
+    return count;
+}
+
+//----------------------------------------------------------------------
+// CoreMap::Print
+// 	Print how many frames are free and pinned, and how many each
+//	address space holds.
+//----------------------------------------------------------------------
+
+void
+CoreMap::Print()
+{
+    int pinned = 0, shared = 0, text = 0;
+
+    for (int i = 0; i < size; i++) {
+	if (entries[i].pinned)
+	    pinned++;
+	if (entries[i].refCount > 1)
+	    shared++;
+	if (entries[i].fileId != -1)
+	    text++;
+    }
+    printf("Core map: %d frames, %d free, %d pinned, %d shared, %d text\n", size,
+	   NumFree(), pinned, shared, text);
+    for (int i = 0; i < size; i++) {
+	AddrSpace *owner = entries[i].owner;
+	int j;
+
+	if (owner == NULL)
+	    continue;
+	for (j = 0; j < i; j++)		// print each address space once
+	    if (entries[j].owner == owner)
+		break;
+	if (j == i)
+	    printf("    address space %d: %d resident pages\n", owner->spaceId,
+		   NumResident(owner));
+    }
+}
@@ -0,0 +1,105 @@
+// coremap.h
+//	Data structures to keep track of physical memory -- the "core map".
+//
+//	There is one entry per physical page (frame), recording the
+//	address space that owns it, the virtual page it holds, whether
+//	it is pinned, and how many address spaces share it.  The dirty
+//	and use bits of a resident page are kept in the page table entry
+//	for the frame (machine->pageTable).
+//
+//	After a copy-on-write Fork, a frame can be mapped by several
+//	address spaces, at the same virtual page: the owner's mapping is
+//	the page table entry for the frame, the others' are alias entries
+//	(see InvertedPageTable).
+//
+//	The core map is also a cache of the text (code) pages of the
+//	executables being run, keyed by (executable, page): a process
+//	that faults on a text page another process running the same
+//	program already has in memory just shares that frame.
+//
+//	Page replacement, address space teardown and the memory
+//	statistics all work from the core map, so they see the pages
+//	of every address space, not just the running one.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef COREMAP_H
+#define COREMAP_H
+
+#include "copyright.h"
+#include "utility.h"
+#include "bitmap.h"
+
+class AddrSpace;
+
+// The following class defines an entry of the core map.
+
+class CoreMapEntry {
+  public:
+    AddrSpace *owner;		// Address space the frame belongs to,
+				// NULL if the frame is free
+    int virtualPage;		// The virtual page held by the frame
+    bool pinned;		// If this bit is set, the frame must not
+				// be chosen for replacement (for instance,
+				// because I/O to it is in progress)
+    int refCount;		// Number of address spaces mapping the
+				// frame, the owner included
+    int fileId;			// The executable (OpenFile::FileId) whose
+				// text page the frame caches, -1 if none
+    int nextText;		// The next frame in the same hash chain
+				// of cached text pages, -1 if none
+};
+
+// The following class defines the core map: which address space and
+// virtual page every frame of physical memory holds.
+
+class CoreMap {
+  public:
+    CoreMap(int numFrames);	// Initialize a core map, with all
+				// "numFrames" frames free
+    ~CoreMap();			// De-allocate the core map
+
+    int Allocate(AddrSpace *owner, int vpn);
+				// Find a free frame and give it to virtual
+				// page "vpn" of "owner".  Return -1 if
+				// all frames are in use.
+    void Assign(int frame, AddrSpace *owner, int vpn);
+				// Give frame "frame", already in use, to
+				// another page (after replacement)
+    void Free(int frame);	// Give frame "frame" back
+    void Share(int frame);	// One more address space maps "frame"
+    void Unshare(int frame, AddrSpace *owner);
+				// One less does; it stays in use, by
+				// "owner" and the others
+
+    void CacheText(int frame, int fileId);
+				// "frame" holds a text page of executable
+				// "fileId", which others may share
+    int FindText(int fileId, int vpn);
+				// Frame holding text page "vpn" of
+				// executable "fileId", -1 if none
+
+    void Pin(int frame);	// Keep "frame" from being replaced
+    void Unpin(int frame);
+
+    int NumFree();		// Number of free frames
+    int NumResident(AddrSpace *owner);	// Number of frames held by "owner"
+
+    void Print();		// Print a summary of memory usage
+
+    CoreMapEntry *entries;	// One entry per frame
+    int size;			// Number of frames
+
+  private:
+    int TextHash(int fileId, int vpn);
+    void UncacheText(int frame);	// "frame" no longer holds the
+				// text page it did, if any
+    BitMap *freeMap;		// Which frames are in use
+    int *textAnchors;		// The first frame of each hash chain of
+				// cached text pages, -1 if the chain is
+				// empty
+};
+
+#endif // COREMAP_H
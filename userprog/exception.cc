@@ -22,9 +22,45 @@
 // of liability and disclaimer of warranty provisions.
 
 #include "copyright.h"
+#include "memsched.h"
 #include "syscall.h"
 #include "system.h"
 
+#define MaxPathLength 256   // longest file name a program may pass
+#define IOBufferSize 4096   // Read and Write go through the kernel in
+                            // pieces this big
+
+//----------------------------------------------------------------------
+// ExitProcess
+// 	The current thread's program is done: give back its address space
+//	and finish the thread.  The main thread has no parent to go back
+//	to, so it halts the machine instead, once what the program wrote
+//	to the files it maps is back in them, and its files are closed.
+//----------------------------------------------------------------------
+
+static void ExitProcess()
+{
+    if (currentThread->parentThread == NULL)
+        {
+            currentThread->space->UnmapFiles();
+            currentThread->space->CloseFiles();
+            interrupt->Halt();
+        }
+
+    delete currentThread->space;
+    currentThread->space = NULL;
+    Thread *pThread = currentThread->parentThread;
+    for (int i = 0; i < MaxChildThreadNum; ++i)
+        {
+            if (pThread->childThread[i] == currentThread)
+                {
+                    pThread->childThread[i] = NULL;
+                    break;
+                }
+        }
+    currentThread->Finish();
+}
+
 //----------------------------------------------------------------------
 // ExceptionHandler
 // 	Entry point into the Nachos kernel.  Called when a user program
@@ -67,25 +103,14 @@ void ExceptionHandler(ExceptionType which)
                                 break;
                             case SC_Exit:
                                 {
-                                    printf("User program exit.\n");
+                                    printf("User program exit, status %d.\n", machine->ReadRegister(4));
                                     machine->printTLBStat();
-                                    delete currentThread->space;
-                                    currentThread->space = NULL;
                                     if (currentThread->parentThread != NULL)
-                                        {
-                                            Thread *pThread = currentThread->parentThread;
-                                            for (int i = 0; i < MaxChildThreadNum; ++i)
-                                                {
-                                                    if (pThread->childThread[i] == currentThread)
-                                                        {
-                                                            pThread->childThread[i] = NULL;
-                                                            break;
-                                                        }
-                                                }
-                                            currentThread->Finish();
-                                        }
-                                    else  // main thread exit
-                                        {
+                                        ExitProcess();
+                                    else  // main thread exit, it still runs
+                                        {  // the startup code up to Halt, so keep its space
+                                            currentThread->space->UnmapFiles();  // Halt won't
+                                            currentThread->space->CloseFiles();
                                             machine->WriteRegister(2, 0);
                                             machine->IncreasePC();
                                         }
@@ -93,7 +118,15 @@ void ExceptionHandler(ExceptionType which)
                                 break;
                             case SC_Exec:
                                 {
-                                    char *name = (char *)machine->ReadRegister(4);
+                                    char *name = new char[MaxPathLength];
+                                    if (machine->CopyInString(machine->ReadRegister(4), name,
+                                                              MaxPathLength) == -1)
+                                        {
+                                            delete[] name;
+                                            machine->WriteRegister(2, -1);
+                                            machine->IncreasePC();
+                                            return;
+                                        }
                                     Thread *newThread = new Thread("Exec");
                                     for (int i = 0; i < MaxChildThreadNum; ++i)
                                         if (currentThread->childThread[i] == NULL)
@@ -105,6 +138,8 @@ void ExceptionHandler(ExceptionType which)
                                                 machine->IncreasePC();
                                                 return;
                                             }
+                                    delete newThread;
+                                    delete[] name;
                                     machine->WriteRegister(2, -1);
                                     machine->IncreasePC();
                                 }
@@ -117,78 +152,165 @@ void ExceptionHandler(ExceptionType which)
                                         {
                                             if (currentThread->childThread[i] == joinThread)
                                                 {
+                                                    // we need no memory while we wait
+                                                    machine->memScheduler->Block(currentThread->space);
                                                     while (currentThread->childThread[i] != NULL)
                                                         currentThread->Yield();
+                                                    machine->memScheduler->Unblock(currentThread->space);
                                                     machine->IncreasePC();
                                                     return;
                                                 }
                                         }
-                                    ASSERT(FALSE);
+                                    machine->IncreasePC();  // it has already exited
                                 }
                                 break;
                             case SC_Create:
                                 {
-                                    char *name = (char *)machine->ReadRegister(4);
-                                    fileSystem->Create(name, 1);
+                                    char name[MaxPathLength];
+                                    if (machine->CopyInString(machine->ReadRegister(4), name,
+                                                              MaxPathLength) != -1)
+                                        fileSystem->Create(name, 1);
                                     // printf("Syscall: Create\t file name:%s\n", name);
                                     machine->IncreasePC();
                                 }
                                 break;
                             case SC_Open:
                                 {
-                                    char *name = (char *)machine->ReadRegister(4);
-                                    OpenFileId id = fileSystem->Open(name);
+                                    char name[MaxPathLength];
+                                    OpenFileId id = -1;
+                                    OpenFile *openFile = NULL;
+                                    if (machine->CopyInString(machine->ReadRegister(4), name,
+                                                              MaxPathLength) != -1)
+                                        openFile = fileSystem->Open(name);
+                                    if (openFile != NULL)
+                                        {
+                                            id = currentThread->space->AddFile(openFile);
+                                            if (id == -1)
+                                                delete openFile;
+                                        }
                                     machine->WriteRegister(2, id);
                                     machine->IncreasePC();
                                 }
                                 break;
                             case SC_Read:
                                 {
-                                    char *buffer = (char *)machine->ReadRegister(4);
+                                    int addr = machine->ReadRegister(4);
                                     int size = (int)machine->ReadRegister(5);
                                     OpenFileId id = (OpenFileId)machine->ReadRegister(6);
-                                    OpenFile *openFile = (OpenFile *)id;
-                                    int result = openFile->Read(buffer, size);
+                                    SharedFile *file = currentThread->space->GetFile(id);
+                                    if (file == NULL)
+                                        {
+                                            machine->WriteRegister(2, -1);
+                                            machine->IncreasePC();
+                                            return;
+                                        }
+                                    OpenFile *openFile = file->file;
+                                    char *buffer = new char[IOBufferSize];
+                                    int result = 0;
+                                    while (result < size)
+                                        {
+                                            int count = openFile->Read(buffer, min(size - result,
+                                                                                   IOBufferSize));
+                                            if (count <= 0)
+                                                break;
+                                            if (!machine->CopyOut(buffer, addr + result, count))
+                                                {
+                                                    result = -1;
+                                                    break;
+                                                }
+                                            result += count;
+                                        }
+                                    delete[] buffer;
                                     machine->WriteRegister(2, result);
                                     machine->IncreasePC();
                                 }
                                 break;
                             case SC_Write:
                                 {
-                                    char *buffer = (char *)machine->ReadRegister(4);
+                                    int addr = machine->ReadRegister(4);
                                     int size = (int)machine->ReadRegister(5);
                                     OpenFileId id = (OpenFileId)machine->ReadRegister(6);
-                                    OpenFile *openFile = (OpenFile *)id;
-                                    openFile->Write(buffer, size);
+                                    SharedFile *file = currentThread->space->GetFile(id);
+                                    if (file == NULL)
+                                        {
+                                            machine->WriteRegister(2, -1);
+                                            machine->IncreasePC();
+                                            return;
+                                        }
+                                    OpenFile *openFile = file->file;
+                                    char *buffer = new char[IOBufferSize];
+                                    int result = 0;
+                                    while (result < size)
+                                        {
+                                            int count = min(size - result, IOBufferSize);
+                                            if (!machine->CopyIn(addr + result, buffer, count))
+                                                break;
+                                            int written = openFile->Write(buffer, count);
+                                            if (written > 0)
+                                                result += written;
+                                            if (written < count)
+                                                break;
+                                        }
+                                    delete[] buffer;
+                                    machine->WriteRegister(2, result);
                                     machine->IncreasePC();
                                 }
                                 break;
                             case SC_Close:
                                 {
                                     OpenFileId id = (OpenFileId)machine->ReadRegister(4);
-                                    OpenFile *openFile = (OpenFile *)id;
-                                    delete openFile;
+                                    currentThread->space->CloseFile(id);
+                                    machine->IncreasePC();
+                                }
+                                break;
+                            case SC_Mmap:
+                                {
+                                    OpenFileId id = (OpenFileId)machine->ReadRegister(4);
+                                    int offset = machine->ReadRegister(5);
+                                    int length = machine->ReadRegister(6);
+                                    SharedFile *file = currentThread->space->GetFile(id);
+                                    int addr = -1;
+                                    if (file != NULL)
+                                        addr = currentThread->space->MapFile(file, offset, length);
+                                    machine->WriteRegister(2, addr);
+                                    machine->IncreasePC();
+                                }
+                                break;
+                            case SC_Munmap:
+                                {
+                                    int addr = machine->ReadRegister(4);
+                                    bool unmapped = currentThread->space->UnmapFile(addr);
+                                    machine->WriteRegister(2, unmapped ? 0 : -1);
+                                    machine->IncreasePC();
+                                }
+                                break;
+                            case SC_Sbrk:
+                                {
+                                    int increment = machine->ReadRegister(4);
+                                    machine->WriteRegister(2, currentThread->space->Sbrk(increment));
                                     machine->IncreasePC();
                                 }
                                 break;
                             case SC_Fork:
                                 {
-                                    char *name = (char *)machine->ReadRegister(4);
-                                    Thread *newThread = new Thread("Exec");
+                                    int func = machine->ReadRegister(4);
+                                    machine->IncreasePC();
                                     for (int i = 0; i < MaxChildThreadNum; ++i)
                                         if (currentThread->childThread[i] == NULL)
                                             {
+                                                Thread *newThread = new Thread("Fork");
                                                 currentThread->childThread[i] = newThread;
                                                 newThread->parentThread = currentThread;
-                                                AddrSpacePC *parentSpacePC = new AddrSpacePC;
-                                                parentSpacePC->space = currentThread->space;
-                                                parentSpacePC->space = machine->ReadRegister(PCReg);
-                                                newThread->Fork(before_fork, parentSpacePC);
-                                                machine->IncreasePC();
-                                                delete parentSpacePC;
+                                                newThread->SaveUserState();  // starts with ours
+                                                AddrSpacePC *childSpacePC = new AddrSpacePC;
+                                                childSpacePC->space =
+                                                    new AddrSpace(currentThread->space);
+                                                childSpacePC->PC = func;
+                                                newThread->Fork(before_fork, childSpacePC);
+                                                machine->WriteRegister(2, (int) newThread);
                                                 return;
                                             }
-                                    machine->IncreasePC();
+                                    machine->WriteRegister(2, -1);  // no free child slot
                                 }
                                 break;
                             case SC_Yield:
@@ -207,6 +329,13 @@ void ExceptionHandler(ExceptionType which)
                 break;
             case PageFaultException:
                 {
+                    int badVAddr = machine->ReadRegister(BadVAddrReg);
+                    if (!currentThread->space->ValidateFault(badVAddr))
+                        {
+                            printf("Segmentation fault at address %d, pc %d\n", badVAddr,
+                                   machine->ReadRegister(PCReg));
+                            ExitProcess();
+                        }
                     if (machine->tlb != NULL)  // TLB miss
                         {
                             machine->TLBMissHandler();
@@ -219,6 +348,7 @@ void ExceptionHandler(ExceptionType which)
                 break;
             case ReadOnlyException:
                 {
+                    machine->CopyOnWriteHandler();
                 }
                 break;
             case BusErrorException:
@@ -227,6 +357,9 @@ void ExceptionHandler(ExceptionType which)
                 break;
             case AddressErrorException:
                 {
+                    printf("Address error at address %d, pc %d\n",
+                           machine->ReadRegister(BadVAddrReg), machine->ReadRegister(PCReg));
+                    ExitProcess();
                 }
                 break;
             case OverflowException:
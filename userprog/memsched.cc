@@ -0,0 +1,247 @@
+// memsched.cc
+//	Routines for the medium-term scheduler: page-fault frequency
+//	resident set limits, and suspension of whole address spaces
+//	when their limits do not fit in memory together.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "memsched.h"
+#include "system.h"
+#include "addrspace.h"
+#include "synch.h"
+
+//----------------------------------------------------------------------
+// MemoryScheduler::MemoryScheduler
+// 	Initialize the medium-term scheduler, with no address spaces.
+//----------------------------------------------------------------------
+
+MemoryScheduler::MemoryScheduler()
+{
+    SetFaultIntervals(1000, 10000);
+    numActive = 0;
+    suspended = new List;
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::~MemoryScheduler
+// 	De-allocate the medium-term scheduler.
+//----------------------------------------------------------------------
+
+MemoryScheduler::~MemoryScheduler()
+{
+    delete suspended;
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::SetFaultIntervals
+// 	Grow the resident set limit of an address space that faults
+//	less than "low" instructions after its previous fault, and
+//	shrink it if more than "high" instructions have passed.  With a
+//	"low" of 0, there are no limits: pages are replaced globally, and
+//	no address space is ever suspended.
+//----------------------------------------------------------------------
+
+void
+MemoryScheduler::SetFaultIntervals(int low, int high)
+{
+    ASSERT(low >= 0 && low <= high);
+    faultIntervalLow = low;
+    faultIntervalHigh = high;
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::Admit
+// 	Address space "space" was just created.  It starts out in
+//	memory, with the smallest resident set limit.
+//----------------------------------------------------------------------
+
+void
+MemoryScheduler::Admit(AddrSpace *space)
+{
+    space->residentLimit = MinResidentPages;
+    space->lastFaultTime = 0;
+    space->suspended = FALSE;
+    space->blocked = FALSE;
+    space->swapTime = stats->totalTicks;
+    space->resumed = new Semaphore("address space resumed", 0);
+    numActive++;
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::Remove
+// 	Address space "space" is going away, and gives its memory back:
+//	resume the suspended address spaces that now fit.  It is not
+//	suspended itself, since its thread is the one deleting it.
+//----------------------------------------------------------------------
+
+void
+MemoryScheduler::Remove(AddrSpace *space)
+{
+    ASSERT(!space->suspended && !space->blocked);
+    numActive--;
+    delete space->resumed;
+    ResumeWaiting();
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::PageFault
+// 	The running address space "space" faulted.  Adapt its resident
+//	set limit to the time since its previous fault, and resume the
+//	address spaces that fit in memory now, or have waited long
+//	enough.
+//
+//	Then, if the address spaces in memory need more than there is,
+//	suspend "space" -- unless it was only just let in, or is alone.
+//	In that case we only return once it is resumed.
+//----------------------------------------------------------------------
+
+void
+MemoryScheduler::PageFault(AddrSpace *space)
+{
+    if (faultIntervalLow == 0)
+	return;
+
+    int now = space->VirtualTime();
+    int interval = now - space->lastFaultTime;
+
+    space->lastFaultTime = now;
+    if (interval < faultIntervalLow && space->residentLimit < NumPhysPages)
+	space->residentLimit++;
+    else if (interval > faultIntervalHigh &&
+	     space->residentLimit > MinResidentPages)
+	space->residentLimit--;
+
+    ResumeWaiting();
+    if (Demand() > NumPhysPages && numActive > 1 &&
+	stats->totalTicks - space->swapTime >= SwapQuantum)
+	Suspend(space);
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::OverLimit
+// 	Return TRUE if address space "space" holds as many frames as its
+//	resident set limit allows, so that it must replace one of its own
+//	pages to get another.  An address space alone in memory may use
+//	all of it.
+//----------------------------------------------------------------------
+
+bool
+MemoryScheduler::OverLimit(AddrSpace *space)
+{
+    if (faultIntervalLow == 0 || numActive < 2)
+	return FALSE;
+    return machine->coreMap->NumResident(space) >= space->residentLimit;
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::Block
+// 	The thread of the running address space "space" is going to wait
+//	for something other than memory (a child, in Join).  Until then,
+//	"space" runs nothing, so its limit no longer counts against those
+//	of the others: resume the address spaces that fit now.
+//----------------------------------------------------------------------
+
+void
+MemoryScheduler::Block(AddrSpace *space)
+{
+    ASSERT(!space->suspended && !space->blocked);
+    space->blocked = TRUE;
+    numActive--;
+    ResumeWaiting();
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::Unblock
+// 	The thread of "space" is done waiting, and runs again.  If memory
+//	is short now, it is suspended at its next fault.
+//----------------------------------------------------------------------
+
+void
+MemoryScheduler::Unblock(AddrSpace *space)
+{
+    ASSERT(space->blocked);
+    space->blocked = FALSE;
+    numActive++;
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::Demand
+// 	Return the sum of the resident set limits of the address spaces
+//	in memory and not blocked.
+//----------------------------------------------------------------------
+
+int
+MemoryScheduler::Demand()
+{
+    int demand = 0;
+
+    for (int i = 0; i < MaxAddrSpaces; i++) {
+	AddrSpace *space = AddrSpace::Lookup(i);
+
+	if (space != NULL && !space->suspended && !space->blocked)
+	    demand += space->residentLimit;
+    }
+    return demand;
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::Suspend
+// 	Take the running address space "space" out of memory: page all
+//	of its pages out, and wait until ResumeWaiting lets it back in.
+//	Its resident set limit is kept, as the memory it will need then.
+//----------------------------------------------------------------------
+
+void
+MemoryScheduler::Suspend(AddrSpace *space)
+{
+    ASSERT(space == currentThread->space);
+    DEBUG('a', "Suspending address space %d, limit %d, demand %d\n",
+	  space->spaceId, space->residentLimit, Demand());
+    space->suspended = TRUE;
+    space->swapTime = stats->totalTicks;
+    numActive--;
+    suspended->Append((void *)space);
+    stats->numSuspends++;
+    machine->SwapOut();
+    space->resumed->P();
+}
+
+//----------------------------------------------------------------------
+// MemoryScheduler::ResumeWaiting
+// 	Resume suspended address spaces, oldest first, as long as they
+//	fit in memory besides the address spaces already there.  The
+//	oldest is also resumed if nothing is in memory, or if it has
+//	waited SwapQuantum ticks; some other address space is then
+//	suspended at its next fault, in its place.
+//
+//	Called on faults, when address spaces go away or block, and on
+//	every timer interrupt (so with interrupts off: the V below only
+//	makes a thread ready).
+//----------------------------------------------------------------------
+
+void
+MemoryScheduler::ResumeWaiting()
+{
+    while (!suspended->IsEmpty()) {
+	AddrSpace *space = (AddrSpace *)suspended->Remove();
+	bool fits = Demand() + space->residentLimit <= NumPhysPages;
+	bool waited = stats->totalTicks - space->swapTime >= SwapQuantum;
+
+	if (!fits && !waited && numActive > 0) {
+	    suspended->Prepend((void *)space);
+	    break;
+	}
+	DEBUG('a', "Resuming address space %d, limit %d\n", space->spaceId,
+	      space->residentLimit);
+	space->suspended = FALSE;
+	space->swapTime = stats->totalTicks;
+	numActive++;
+	stats->numResumes++;
+	space->resumed->V();
+	if (!fits)
+	    break;
+    }
+}
@@ -0,0 +1,88 @@
+// memsched.h
+//	Data structures for the medium-term scheduler, which keeps
+//	multiprogrammed user programs from thrashing.
+//
+//	Each address space may hold a limited number of frames, its
+//	"resident set limit".  The limit follows the page-fault frequency
+//	of the address space: it grows by a frame when the address space
+//	faults again soon after its last fault (measured in instructions
+//	it ran, not in total time), and shrinks by a frame when the
+//	faults are far apart.  An address space at its limit replaces
+//	one of its own pages on a fault, instead of taking a page from
+//	another address space.
+//
+//	When the limits of the address spaces in memory add up to more
+//	than physical memory, an address space that faults is suspended:
+//	all of its pages are paged out (Machine::SwapOut), and its thread
+//	waits until the others need less memory, or until it has waited
+//	SwapQuantum ticks.  Then it is resumed, and faults its pages back
+//	in.  An address space is never suspended less than SwapQuantum
+//	ticks after it was created or resumed, so that it gets some work
+//	done, and the last one in memory is never suspended.  Suspended
+//	address spaces are looked at on every fault and every timer
+//	interrupt, so they get back in even when no address space faults.
+//
+//	An address space whose thread is blocked (in Join) runs nothing,
+//	so it is not counted among those needing memory until it wakes up.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef MEMSCHED_H
+#define MEMSCHED_H
+
+#include "copyright.h"
+#include "list.h"
+
+class AddrSpace;
+
+#define MinResidentPages	4	// smallest resident set limit
+#define SwapQuantum		50000	// ticks an address space stays in
+					// (or out of) memory, at least
+
+// The following class defines the medium-term scheduler.
+
+class MemoryScheduler {
+  public:
+    MemoryScheduler();			// Initialize the scheduler, with
+					// the default fault intervals
+    ~MemoryScheduler();			// De-allocate the scheduler
+
+    void SetFaultIntervals(int low, int high);
+					// Grow the limit of an address space
+					// that faults within "low"
+					// instructions, shrink it past
+					// "high"; a "low" of 0 turns
+					// resident set limits off
+    void Admit(AddrSpace *space);	// "space" was just created
+    void Remove(AddrSpace *space);	// "space" is going away
+    void PageFault(AddrSpace *space);	// The running address space
+					// "space" faulted: adapt its limit,
+					// and maybe suspend it until there
+					// is room for it
+    bool OverLimit(AddrSpace *space);	// Must "space" replace one of its
+					// own pages to get another?
+    void Block(AddrSpace *space);	// The thread of "space" waits for
+    void Unblock(AddrSpace *space);	// something besides memory, or is
+					// done waiting
+    void ResumeWaiting();		// Resume the suspended address
+					// spaces that fit, or have waited
+					// long enough
+
+  private:
+    int Demand();			// Sum of the limits of the address
+					// spaces in memory
+    void Suspend(AddrSpace *space);	// Swap the running address space
+					// out, and wait until resumed
+
+    int faultIntervalLow;		// Faults closer than this grow the
+					// resident set limit
+    int faultIntervalHigh;		// Faults further apart shrink it
+    int numActive;			// Address spaces neither suspended
+					// nor blocked
+    List *suspended;			// Suspended address spaces, in the
+					// order they were suspended
+};
+
+#endif // MEMSCHED_H
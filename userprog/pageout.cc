@@ -0,0 +1,128 @@
+// pageout.cc
+//	Routines for the page-out daemon, which frees physical pages
+//	ahead of the page faults that will need them.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "pageout.h"
+#include "system.h"
+#include "swapdisk.h"
+
+//----------------------------------------------------------------------
+// PageOutThread
+// 	The page-out daemon thread.  Since a thread can only be forked
+//	to run a procedure, not a method, we need this dummy procedure.
+//----------------------------------------------------------------------
+
+static void
+PageOutThread(int arg)
+{
+    PageOutDaemon *daemon = (PageOutDaemon *)arg;
+
+    daemon->Run();
+}
+
+//----------------------------------------------------------------------
+// PageOutDaemon::PageOutDaemon
+// 	Initialize the page-out daemon, and start its thread, which
+//	waits until it is needed.
+//
+//	"low", "high" -- the watermarks, see SetWatermarks.
+//----------------------------------------------------------------------
+
+PageOutDaemon::PageOutDaemon(int low, int high)
+{
+    SetWatermarks(low, high);
+    wakeupPending = FALSE;
+    wakeup = new Semaphore("page-out daemon wakeup", 0);
+
+    Thread *t = new Thread("page-out daemon");
+
+    t->Fork(PageOutThread, (void *)this);
+}
+
+//----------------------------------------------------------------------
+// PageOutDaemon::~PageOutDaemon
+// 	De-allocate the page-out daemon.  We only get here when Nachos
+//	halts, so the thread is gone for good.
+//----------------------------------------------------------------------
+
+PageOutDaemon::~PageOutDaemon()
+{
+    delete wakeup;
+}
+
+//----------------------------------------------------------------------
+// PageOutDaemon::SetWatermarks
+// 	Have the daemon woken up when fewer than "low" frames are free,
+//	and page out until "high" frames are.  With a "low" of 0, the
+//	daemon is never woken up, and pages are only replaced by the
+//	threads faulting on others.
+//----------------------------------------------------------------------
+
+void
+PageOutDaemon::SetWatermarks(int low, int high)
+{
+    ASSERT(low >= 0 && low <= high && high <= NumPhysPages);
+    lowWater = low;
+    highWater = high;
+}
+
+//----------------------------------------------------------------------
+// PageOutDaemon::FramesTaken
+// 	Called when frames have been allocated.  If fewer than the low
+//	watermark are left free, wake the daemon up, unless it is at
+//	work already.  May let other threads run, so the frames just
+//	allocated must be pinned.
+//----------------------------------------------------------------------
+
+void
+PageOutDaemon::FramesTaken()
+{
+    if (!wakeupPending && machine->coreMap->NumFree() < lowWater) {
+	wakeupPending = TRUE;
+	wakeup->V();
+    }
+}
+
+//----------------------------------------------------------------------
+// PageOutDaemon::Run
+// 	Each time we are woken up, page out and free the pages chosen by
+//	the clock algorithm, until the high watermark is reached or no
+//	page can be replaced (all of them are pinned).
+//
+//	The pages are taken from any address space; we have none of our
+//	own.  Throttle before each page-out, so that we cannot get far
+//	ahead of the swap disk.
+//----------------------------------------------------------------------
+
+void
+PageOutDaemon::Run()
+{
+    CoreMap *coreMap = machine->coreMap;
+
+    for (;;) {
+	wakeup->P();
+	stats->numPageOutWakeups++;
+	DEBUG('a', "Page-out daemon woken up, %d frames free\n",
+	      coreMap->NumFree());
+
+	for (;;) {
+	    machine->swapDisk->Throttle();
+	    if (coreMap->NumFree() >= highWater)
+		break;
+	    int frame = machine->ChooseVictimFrame();
+	    if (frame == -1)
+		break;
+	    coreMap->Pin(frame);	// not chosen again while we wait
+	    machine->PageOut(frame);
+	    coreMap->Unpin(frame);
+	    coreMap->Free(frame);
+	    stats->numPageOutFrees++;
+	}
+	wakeupPending = FALSE;
+    }
+}
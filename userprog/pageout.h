@@ -0,0 +1,47 @@
+// pageout.h
+//	Data structures for the page-out daemon: a kernel thread that
+//	keeps a pool of free physical pages, so that a page fault can
+//	normally be served without first replacing a page.
+//
+//	When the number of free frames drops below the "low watermark",
+//	the thread is woken up, and pages out the pages the clock
+//	algorithm chooses (see Machine::ChooseVictimFrame) until the
+//	"high watermark" is reached.  The writes to swap space it causes
+//	are queued, like any others (see SwapDisk).  A faulting thread
+//	only replaces a page itself when the pool has run dry anyway.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef PAGEOUT_H
+#define PAGEOUT_H
+
+#include "copyright.h"
+#include "synch.h"
+
+// The following class defines the page-out daemon.
+
+class PageOutDaemon {
+  public:
+    PageOutDaemon(int low, int high);	// Start the daemon, with the
+					// given watermarks
+    ~PageOutDaemon();			// De-allocate the daemon
+
+    void SetWatermarks(int low, int high);
+					// Wake up below "low" free frames,
+					// free frames up to "high"; a "low"
+					// of 0 turns the daemon off
+    void FramesTaken();			// Frames were just allocated: wake
+					// the daemon up if few are left
+
+    void Run();				// Body of the daemon; never returns
+
+  private:
+    int lowWater;			// Wake up below this many free frames
+    int highWater;			// Stop paging out at this many
+    bool wakeupPending;			// Woken up, and not done yet
+    Semaphore *wakeup;			// V'ed to wake the daemon up
+};
+
+#endif // PAGEOUT_H
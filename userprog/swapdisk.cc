@@ -0,0 +1,440 @@
+// swapdisk.cc
+//	Routines to read and write pages on the swap device.  Page writes
+//	are done behind the back of the thread that asked for them, by
+//	the "swap writer" thread.
+//
+//	Pages kept in the compressed pool are encoded as a sequence of
+//	runs of words, each starting with a byte: the kind of run in
+//	the top two bits, and the number of words, less one, in the
+//	others.  A run of zeros, or of copies of the word before it, is
+//	just that byte; a run of other ("literal") words is followed by
+//	the words themselves.  Arrays being initialized, and the stack,
+//	are mostly such runs.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#include "copyright.h"
+#include "swapdisk.h"
+#include "system.h"
+
+// A write to the swap device that has been queued, but not yet done.
+
+class PendingWrite {
+  public:
+    int page;		// The slot to write
+    char *data;		// What to write there; sectorsPerPage sectors
+};
+
+enum RunKind { LiteralRun, ZeroRun, RepeatRun };
+
+#define MaxRun		64	// words in a run, at most
+#define RunByte(kind, n)	(((kind) << 6) | ((n) - 1))
+
+//----------------------------------------------------------------------
+// IsZeroPage
+// 	Return TRUE if the PageSize bytes at "data" are all zeros.
+//----------------------------------------------------------------------
+
+static bool
+IsZeroPage(char *data)
+{
+    unsigned int *words = (unsigned int *)data;
+
+    for (int i = 0; i < PageSize / 4; i++)
+	if (words[i] != 0)
+	    return FALSE;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// CompressPage
+// 	Encode the PageSize bytes at "data" into "into", in runs of words
+//	(see above).  Return the number of bytes used, or -1 if that
+//	would be more than "limit".
+//----------------------------------------------------------------------
+
+static int
+CompressPage(char *data, char *into, int limit)
+{
+    unsigned int *words = (unsigned int *)data;
+    int numWords = PageSize / 4;
+    unsigned int previous = 0;
+    int size = 0;
+
+    for (int i = 0; i < numWords; ) {
+	RunKind kind;
+	int n = 1;
+
+	if (words[i] == 0) {
+	    kind = ZeroRun;
+	    while (i + n < numWords && n < MaxRun && words[i + n] == 0)
+		n++;
+	} else if (words[i] == previous) {
+	    kind = RepeatRun;
+	    while (i + n < numWords && n < MaxRun && words[i + n] == previous)
+		n++;
+	} else {
+	    kind = LiteralRun;
+	    while (i + n < numWords && n < MaxRun && words[i + n] != 0 &&
+		   words[i + n] != words[i + n - 1])
+		n++;
+	}
+	if (size + 1 + (kind == LiteralRun ? 4 * n : 0) > limit)
+	    return -1;
+	into[size++] = RunByte(kind, n);
+	if (kind == LiteralRun) {
+	    bcopy((char *)&words[i], &into[size], 4 * n);
+	    size += 4 * n;
+	    previous = words[i + n - 1];
+	} else if (kind == ZeroRun)
+	    previous = 0;
+	i += n;
+    }
+    return size;
+}
+
+//----------------------------------------------------------------------
+// DecompressPage
+// 	Decode the "size" bytes at "from", encoded by CompressPage, into
+//	the PageSize bytes at "data".
+//----------------------------------------------------------------------
+
+static void
+DecompressPage(char *from, int size, char *data)
+{
+    unsigned int *words = (unsigned int *)data;
+    unsigned int previous = 0;
+    int i = 0;
+
+    for (int k = 0; k < size; ) {
+	int kind = (from[k] >> 6) & 3;
+	int n = (from[k++] & 0x3f) + 1;
+
+	ASSERT(i + n <= PageSize / 4);
+	if (kind == LiteralRun) {
+	    bcopy(&from[k], (char *)&words[i], 4 * n);
+	    k += 4 * n;
+	    previous = words[i + n - 1];
+	} else {
+	    if (kind == ZeroRun)
+		previous = 0;
+	    for (int j = 0; j < n; j++)
+		words[i + j] = previous;
+	}
+	i += n;
+    }
+    ASSERT(i == PageSize / 4);
+}
+
+//----------------------------------------------------------------------
+// SwapWriter
+// 	The swap writer thread.  Since a thread can only be forked to
+//	run a procedure, not a method, we need this dummy procedure.
+//----------------------------------------------------------------------
+
+static void
+SwapWriter(int arg)
+{
+    SwapDisk *swap = (SwapDisk *)arg;
+
+    swap->WriteBehind();
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::SwapDisk
+// 	Initialize a swap device of "numPages" page-sized slots, all of
+//	them free, and start the thread that writes pages out.
+//
+//	"name" is the host file holding the simulated disk.
+//----------------------------------------------------------------------
+
+SwapDisk::SwapDisk(char *name, int numPages)
+{
+    numSlots = numPages;
+    sectorsPerPage = divRoundUp(PageSize, SectorSize);
+    ASSERT(numPages * sectorsPerPage <= NumSectors);
+    disk = new SynchDisk(name);
+    sectorBuffer = new char[SectorSize];
+    freeMap = new BitMap(numPages);
+    refCount = new int[numPages];
+    pending = new PendingWrite *[numPages];
+    packed = new char *[numPages];
+    packedSize = new int[numPages];
+    for (int i = 0; i < numPages; i++) {
+	refCount[i] = 0;
+	pending[i] = NULL;
+	packed[i] = NULL;
+	packedSize[i] = -1;
+    }
+    packBuffer = new char[PageSize];
+    poolSize = poolUsed = 0;
+    queue = new List;
+    numQueued = 0;
+    lock = new Lock("swap disk lock");
+    queueNotEmpty = new Condition("swap queue not empty");
+    writeDone = new Condition("swap write done");
+
+    Thread *t = new Thread("swap writer");
+
+    t->Fork(SwapWriter, (void *)this);
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::~SwapDisk
+// 	De-allocate the swap device.  Writes still queued are lost, which
+//	is fine, since we only get here when Nachos halts.
+//----------------------------------------------------------------------
+
+SwapDisk::~SwapDisk()
+{
+    delete disk;
+    delete [] sectorBuffer;
+    delete freeMap;
+    delete [] refCount;
+    delete [] pending;
+    for (int i = 0; i < numSlots; i++)
+	delete [] packed[i];
+    delete [] packed;
+    delete [] packedSize;
+    delete [] packBuffer;
+    delete queue;
+    delete lock;
+    delete queueNotEmpty;
+    delete writeDone;
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::AllocatePage
+// 	Find a free slot, mark it in use and return it.  Return -1 if the
+//	swap device is full.
+//----------------------------------------------------------------------
+
+int
+SwapDisk::AllocatePage()
+{
+    int page = freeMap->Find();
+
+    if (page != -1)
+	refCount[page] = 1;
+    return page;
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::SharePage
+// 	Record that one more address space uses slot "page", which is
+//	in use: it will give the slot back too.
+//----------------------------------------------------------------------
+
+void
+SwapDisk::SharePage(int page)
+{
+    ASSERT(freeMap->Test(page));
+    refCount[page]++;
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::FreePage
+// 	Give slot "page" back.  When nobody uses it any more, it is free,
+//	and if its contents have not been written out yet, they never
+//	will be.
+//----------------------------------------------------------------------
+
+void
+SwapDisk::FreePage(int page)
+{
+    ASSERT(freeMap->Test(page) && refCount[page] > 0);
+    if (--refCount[page] > 0)
+	return;
+    pending[page] = NULL;		// the writer will skip it
+    Unpack(page);
+    freeMap->Clear(page);
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::ReadPage
+// 	Read the contents of slot "page" into "data" (PageSize bytes).
+//	If the slot is in the pool, decompress it; if its write is still
+//	queued, just copy the data waiting to be written; otherwise, wait
+//	for the disk.
+//----------------------------------------------------------------------
+
+void
+SwapDisk::ReadPage(int page, char *data)
+{
+    ASSERT(freeMap->Test(page));
+    if (packedSize[page] == 0) {
+	bzero(data, PageSize);
+	return;
+    }
+    if (packedSize[page] > 0) {
+	DecompressPage(packed[page], packedSize[page], data);
+	return;
+    }
+    if (pending[page] != NULL) {
+	bcopy(pending[page]->data, data, PageSize);
+	return;
+    }
+
+    int sector = page * sectorsPerPage;
+
+    DEBUG('a', "Reading swap page %d\n", page);
+    for (int offset = 0; offset < PageSize; offset += SectorSize, sector++) {
+	if (PageSize - offset >= SectorSize)
+	    disk->ReadSector(sector, &data[offset]);
+	else {				// the page ends in this sector
+	    disk->ReadSector(sector, sectorBuffer);
+	    bcopy(sectorBuffer, &data[offset], PageSize - offset);
+	}
+    }
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::WritePage
+// 	Queue the write of "data" (PageSize bytes) to slot "page", and
+//	return at once; the swap writer thread will do the write.  The
+//	data is copied, so the caller can reuse "data" right away.
+//
+//	If the page can be kept in the pool instead, there is nothing to
+//	write.
+//----------------------------------------------------------------------
+
+void
+SwapDisk::WritePage(int page, char *data)
+{
+    ASSERT(freeMap->Test(page));
+    Unpack(page);
+    if (Pack(page, data)) {
+	pending[page] = NULL;		// an older write is skipped
+	return;
+    }
+
+    PendingWrite *w = new PendingWrite;
+
+    w->page = page;
+    w->data = new char[sectorsPerPage * SectorSize];
+    bcopy(data, w->data, PageSize);
+    pending[page] = w;
+
+    lock->Acquire();
+    queue->Append((void *)w);
+    numQueued++;
+    queueNotEmpty->Signal(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::Throttle
+// 	Wait until no more than MaxPendingWrites writes are queued, so
+//	that page-outs cannot get arbitrarily far ahead of the disk.
+//	Called only where nothing is half done, since other threads run
+//	in the meantime.
+//----------------------------------------------------------------------
+
+void
+SwapDisk::Throttle()
+{
+    lock->Acquire();
+    while (numQueued > MaxPendingWrites)
+	writeDone->Wait(lock);
+    lock->Release();
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::SetPoolSize
+// 	Keep up to "bytes" bytes of compressed pages in memory, rather
+//	than on the disk.  With 0, every page goes to the disk.  Must be
+//	called before anything is paged out.
+//----------------------------------------------------------------------
+
+void
+SwapDisk::SetPoolSize(int bytes)
+{
+    ASSERT(bytes >= 0 && poolUsed == 0);
+    poolSize = bytes;
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::Pack
+// 	Keep the PageSize bytes at "data" in the pool, as the contents of
+//	slot "page".  A page of zeros takes no room; other pages are
+//	compressed, and kept if they shrink to 3/4 of their size or less
+//	and fit in what is left of the pool.  Return FALSE if the page
+//	must go to the disk.
+//----------------------------------------------------------------------
+
+bool
+SwapDisk::Pack(int page, char *data)
+{
+    if (poolSize == 0)
+	return FALSE;
+
+    int size = IsZeroPage(data) ? 0 : CompressPage(data, packBuffer, PageSize * 3 / 4);
+
+    if (size == -1 || poolUsed + size > poolSize)
+	return FALSE;
+    if (size > 0) {
+	packed[page] = new char[size];
+	bcopy(packBuffer, packed[page], size);
+	poolUsed += size;
+	stats->numPackedPageOuts++;
+    } else
+	stats->numZeroPageOuts++;
+    packedSize[page] = size;
+    return TRUE;
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::Unpack
+// 	Forget the contents of slot "page" kept in the pool, if any, and
+//	give back the room they took.
+//----------------------------------------------------------------------
+
+void
+SwapDisk::Unpack(int page)
+{
+    if (packedSize[page] > 0) {
+	delete [] packed[page];
+	packed[page] = NULL;
+	poolUsed -= packedSize[page];
+    }
+    packedSize[page] = -1;
+}
+
+//----------------------------------------------------------------------
+// SwapDisk::WriteBehind
+// 	Write the queued pages out, oldest first, waiting for more when
+//	the queue is empty.  A write whose slot was freed (or rewritten)
+//	in the meantime is skipped.
+//----------------------------------------------------------------------
+
+void
+SwapDisk::WriteBehind()
+{
+    for (;;) {
+	PendingWrite *w;
+
+	lock->Acquire();
+	while (queue->IsEmpty())
+	    queueNotEmpty->Wait(lock);
+	w = (PendingWrite *)queue->Remove();
+	lock->Release();
+
+	if (pending[w->page] == w) {
+	    DEBUG('a', "Writing swap page %d\n", w->page);
+	    for (int i = 0; i < sectorsPerPage; i++)
+		disk->WriteSector(w->page * sectorsPerPage + i,
+				  &w->data[i * SectorSize]);
+	    if (pending[w->page] == w)	// not freed while we waited
+		pending[w->page] = NULL;
+	}
+	delete [] w->data;
+	delete w;
+
+	lock->Acquire();
+	numQueued--;
+	writeDone->Broadcast(lock);
+	lock->Release();
+    }
+}
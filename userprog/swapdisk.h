@@ -0,0 +1,106 @@
+// swapdisk.h
+//	Data structures for the swap device: a simulated disk on which
+//	pages that do not fit in physical memory are kept.
+//
+//	The disk is divided into page-sized slots ("swap pages"), each
+//	taking as many sectors as it needs.  Reading a page waits for the
+//	disk, like SynchDisk does.  Writing a page does not: the contents
+//	are copied aside, and a separate thread writes them out in the
+//	order they were queued.  Until then, reads are served from the
+//	copy, so a page that is faulted back in soon after being paged out
+//	costs no disk I/O at all.
+//
+//	A slot can be shared by address spaces forked from one another;
+//	it is only freed when the last of them gives it back.
+//
+//	Optionally, a slot's contents are kept in main memory instead,
+//	compressed, in a pool of limited size: then neither the write nor
+//	the read of the slot goes to the disk.  A page of zeros takes no
+//	room in the pool at all.  Pages that do not compress well, or do
+//	not fit in the pool any more, go to the disk as usual.
+//
+// Copyright (c) 1992-1993 The Regents of the University of California.
+// All rights reserved.  See copyright.h for copyright notice and limitation
+// of liability and disclaimer of warranty provisions.
+
+#ifndef SWAPDISK_H
+#define SWAPDISK_H
+
+#include "copyright.h"
+#include "synchdisk.h"
+#include "bitmap.h"
+#include "list.h"
+
+#define MaxPendingWrites	8	// number of page writes that may be
+					// queued before Throttle waits
+
+class PendingWrite;
+
+// The following class defines the swap device.
+
+class SwapDisk {
+  public:
+    SwapDisk(char *name, int numPages);	// Initialize a swap device with
+					// "numPages" slots, on the disk in
+					// host file "name"
+    ~SwapDisk();			// De-allocate the swap device
+
+    int AllocatePage();			// Find a free slot; -1 if none
+    void SharePage(int page);		// One more address space uses
+					// slot "page"
+    bool IsShared(int page) { return refCount[page] > 1; }
+					// Is slot "page" used by more than
+					// one address space?
+    void FreePage(int page);		// Give a slot back; the last user
+					// to do so frees it, forgetting its
+					// contents
+
+    void ReadPage(int page, char *data);
+					// Read slot "page" into "data",
+					// returning once it is read
+    void WritePage(int page, char *data);
+					// Queue the write of "data" to slot
+					// "page"; "data" can be reused as
+					// soon as this returns
+    void Throttle();			// Wait while more than
+					// MaxPendingWrites writes are queued
+    void SetPoolSize(int bytes);	// Keep up to "bytes" bytes of
+					// compressed pages in memory; 0
+					// turns the pool off
+
+    void WriteBehind();			// Body of the thread that writes
+					// queued pages out; never returns
+
+  private:
+    SynchDisk *disk;			// The disk holding the slots
+    int numSlots;			// Number of slots
+    int sectorsPerPage;			// Number of sectors in a slot
+    char *sectorBuffer;			// For a slot ending in the middle
+					// of a sector
+    BitMap *freeMap;			// Which slots are in use
+    int *refCount;			// For each slot, the number of
+					// address spaces using it
+    PendingWrite **pending;		// For each slot, the write not yet
+					// done, if any
+    List *queue;			// Writes not yet done, oldest first
+    int numQueued;			// Writes queued or being done
+    Lock *lock;				// Protects queue and numQueued
+    Condition *queueNotEmpty;		// Signalled when a write is queued
+    Condition *writeDone;		// Signalled when a write is done
+
+    bool Pack(int page, char *data);	// Keep "data" in the pool, as the
+					// contents of slot "page", if we can
+    void Unpack(int page);		// Forget the pooled contents of
+					// slot "page", if any
+    int poolSize;			// Bytes the pool may hold; 0 if
+					// there is no pool
+    int poolUsed;			// Bytes it does hold
+    char **packed;			// For each slot, its contents, if
+					// compressed into the pool
+    int *packedSize;			// Size of those, in bytes; 0 for a
+					// page of zeros, -1 if the slot is
+					// not in the pool
+    char *packBuffer;			// Where a page is compressed
+};
+
+#endif // SWAPDISK_H
@@ -29,6 +29,9 @@
 #define SC_Close	8
 #define SC_Fork		9
 #define SC_Yield	10
+#define SC_Mmap		11
+#define SC_Munmap	12
+#define SC_Sbrk		13
 
 #ifndef IN_ASM
 
@@ -81,6 +84,9 @@ typedef int OpenFileId;
  * keyboard input and display output (in UNIX terms, stdin and stdout).
  * Read and Write can be used directly on these, without first opening
  * the console device.
+ *
+ * Not implemented yet: the console ids are reserved, but Read and
+ * Write on them fail, returning -1.
  */
 
 #define ConsoleInput	0  
@@ -90,34 +96,63 @@ typedef int OpenFileId;
 void Create(char *name);
 
 /* Open the Nachos file "name", and return an "OpenFileId" that can 
- * be used to read and write to the file.
+ * be used to read and write to the file: the lowest one not in use,
+ * or -1 if the file cannot be opened.  A process forked by Fork
+ * inherits the open files, and shares their position in the file.
+ * The files still open at Exit are closed.
  */
 OpenFileId Open(char *name);
 
-/* Write "size" bytes from "buffer" to the open file. */
-void Write(char *buffer, int size, OpenFileId id);
+/* Write "size" bytes from "buffer" to the open file.  Return the number
+ * of bytes written, or -1 if "id" is not an open file.
+ */
+int Write(char *buffer, int size, OpenFileId id);
 
 /* Read "size" bytes from the open file into "buffer".  
  * Return the number of bytes actually read -- if the open file isn't
  * long enough, or if it is an I/O device, and there aren't enough 
  * characters to read, return whatever is available (for I/O devices, 
  * you should always wait until you can return at least one character).
+ * Return -1 if "id" is not an open file.
  */
 int Read(char *buffer, int size, OpenFileId id);
 
 /* Close the file, we're done reading and writing to it. */
 void Close(OpenFileId id);
 
+/* Map "length" bytes of the open file, starting at "offset", into the
+ * address space, and return the address of the mapping (-1 on error).
+ * The file is read as the mapping is touched; what is written to the
+ * mapping goes back to the file, at the latest by Munmap or Exit.
+ * The mapping stays valid if the file is closed.
+ */
+int Mmap(OpenFileId id, int offset, int length);
+
+/* Remove the mapping at "addr", returned by Mmap.  Return 0, or -1 if
+ * there is no mapping there.
+ */
+int Munmap(int addr);
+
+/* Move the end of the heap, which starts right after the program, by
+ * "increment" bytes (which may be negative).  Return the old end, or
+ * -1 if the heap cannot grow or shrink that far.  The new memory reads
+ * as zeros.
+ */
+int Sbrk(int increment);
+
 
 
 /* User-level thread operations: Fork and Yield.  To allow multiple
  * threads to run within a user program. 
  */
 
-/* Fork a thread to run a procedure ("func") in the *same* address space 
- * as the current thread.
+/* Fork a thread to run a procedure ("func") in a copy of the current
+ * thread's address space.  The copy is made copy-on-write: pages are
+ * shared until either thread writes them, so neither sees the other's
+ * writes.  "func" must end with Exit.  Return an identifier that Join
+ * accepts, or -1 if the thread has too many children.
  */
-void Fork(void (*func)());
+SpaceId Fork(void (*func)());
 
 /* Yield the CPU to another runnable thread, whether in this address space 
  * or not. 